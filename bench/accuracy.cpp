@@ -0,0 +1,359 @@
+// Accuracy of kde1d against a brute-force reference estimator.
+//
+// Usage:
+//   accuracy [--max_n=10000] [--benchmark_out=<file.json>]
+//
+// For each distribution and sample size, the model is compared to the
+// local polynomial estimator with the same bandwidth, evaluated by direct
+// kernel sums (`Kde1d::pdf_exact()`) and normalized by numerical
+// integration. Reported are
+//   - pdf: max/mean absolute error relative to the maximum of the reference,
+//   - cdf: max/mean absolute error,
+//   - quantile: max/mean of |F_ref(q(p)) - p| for p in [0.001, 0.999] (the
+//     error on the probability scale, which is well-defined where the density
+//     is flat),
+//   - pdf tails: max relative pdf error including the outermost grid cells,
+// and the time per evaluation point of the model and the reference. pdf and
+// cdf errors are measured in the bulk of the distribution (see run_case()).
+// The program exits with status 1 if any error exceeds its threshold.
+
+#include "../include/kde1d.hpp"
+#include "harness.hpp"
+#include <random>
+
+using namespace kde1d;
+
+namespace {
+
+struct Case
+{
+  std::string name;
+  double xmin;
+  double xmax;
+  std::string type;
+  std::function<double(std::mt19937&)> draw;
+};
+
+std::vector<Case>
+cases()
+{
+  std::normal_distribution<double> normal;
+  std::lognormal_distribution<double> lognormal;
+  std::gamma_distribution<double> gamma_a(2.0), gamma_b(5.0), gamma_zi(2.0);
+  std::poisson_distribution<int> poisson(5.0);
+  std::uniform_real_distribution<double> unif;
+  return {
+    { "normal", NAN, NAN, "c", [=](std::mt19937& g) mutable {
+       return normal(g);
+     } },
+    { "lognormal", 0.0, NAN, "c", [=](std::mt19937& g) mutable {
+       return lognormal(g);
+     } },
+    { "beta(2,5)", 0.0, 1.0, "c", [=](std::mt19937& g) mutable {
+       double a = gamma_a(g);
+       return a / (a + gamma_b(g));
+     } },
+    { "normal mixture", NAN, NAN, "c", [=](std::mt19937& g) mutable {
+       return (unif(g) < 0.5) ? normal(g) - 2.0 : 0.5 * normal(g) + 2.0;
+     } },
+    { "poisson(5)", 0.0, NAN, "d", [=](std::mt19937& g) mutable {
+       return static_cast<double>(poisson(g));
+     } },
+    { "zi gamma(2)", 0.0, NAN, "zi", [=](std::mt19937& g) mutable {
+       return (unif(g) < 0.3) ? 0.0 : gamma_zi(g);
+     } }
+  };
+}
+
+// maximum errors allowed; about three times the largest errors observed for
+// n >= 1000. For smaller samples, the grid is coarser and the boundary cells
+// carry more mass, so the thresholds grow proportionally to 1 / n.
+struct Thresholds
+{
+  double pdf = 1e-2;
+  double cdf = 5e-3;
+  double quantile = 5e-3;
+
+  Thresholds(size_t n)
+  {
+    double factor = std::max(1000.0 / static_cast<double>(n), 1.0);
+    pdf *= factor;
+    cdf *= factor;
+    quantile *= factor;
+  }
+};
+
+struct Result
+{
+  std::string name;
+  size_t n;
+  double pdf_max, pdf_mean, cdf_max, cdf_mean, q_max, q_mean, pdf_tails;
+  double fit_us, model_ns, reference_ns;
+};
+
+template<class F>
+double
+time_ns(F f, double points)
+{
+  auto start = std::chrono::steady_clock::now();
+  f();
+  std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+  return t.count() * 1e9 / points;
+}
+
+// brute-force reference: the exact local polynomial estimate, normalized
+// numerically; the cdf is integrated on a refinement of the model's grid
+// (which is dense where the density changes quickly near boundaries)
+class Reference
+{
+public:
+  Reference(const Kde1d& fit, const Eigen::VectorXd& data)
+    : fit_(fit)
+    , data_(data)
+  {
+    Eigen::VectorXd model_grid = fit.get_grid_points();
+    long m = model_grid.size();
+    if (fit.get_type() == VarType::discrete) {
+      double lower = std::ceil(model_grid(0));
+      double upper = std::floor(model_grid(m - 1));
+      auto levels = static_cast<long>(upper - lower + 1);
+      grid_ = Eigen::VectorXd::LinSpaced(levels, lower, upper);
+      cdf_ = fit.pdf_exact(grid_, data);
+      for (long i = 1; i < cdf_.size(); ++i)
+        cdf_(i) += cdf_(i - 1);
+      return;
+    }
+
+    // Simpson's rule on each subcell
+    const long refine = 16;
+    grid_.resize((m - 1) * refine + 1);
+    for (long i = 0; i < m - 1; ++i) {
+      grid_.segment(i * refine, refine) = Eigen::VectorXd::LinSpaced(
+        refine + 1, model_grid(i), model_grid(i + 1)).head(refine);
+    }
+    grid_(grid_.size() - 1) = model_grid(m - 1);
+    long k = grid_.size();
+    Eigen::VectorXd mid = 0.5 * (grid_.head(k - 1) + grid_.tail(k - 1));
+    Eigen::VectorXd f = continuous(grid_), f_mid = continuous(mid);
+    cdf_ = Eigen::VectorXd::Zero(k);
+    for (long i = 1; i < k; ++i) {
+      double dx = grid_(i) - grid_(i - 1);
+      cdf_(i) = cdf_(i - 1) + dx * (f(i - 1) + 4 * f_mid(i - 1) + f(i)) / 6;
+    }
+
+    // the continuous part has mass 1 - prob0
+    double prob0 = fit.get_prob0();
+    scale_ = (1 - prob0) / cdf_(k - 1);
+    cdf_ = cdf_ * scale_;
+    if (prob0 > 0)
+      cdf_ = (grid_.array() >= 0).select(cdf_.array() + prob0, cdf_);
+  }
+
+  // exact (for zero-inflated data, the point mass at 0)
+  Eigen::VectorXd get_pdf(const Eigen::VectorXd& x) const
+  {
+    Eigen::VectorXd f = fit_.pdf_exact(x, data_);
+    if (fit_.get_type() == VarType::discrete)
+      return f;
+    if (fit_.get_prob0() > 0)
+      return (x.array() == 0).select(f, f * scale_);
+    return f * scale_;
+  }
+
+  // linear interpolation between the grid points (exact at the levels for
+  // discrete data); zero below the grid
+  Eigen::VectorXd get_cdf(const Eigen::VectorXd& x) const
+  {
+    const double* begin = grid_.data();
+    long m = grid_.size();
+    Eigen::VectorXd res(x.size());
+    for (long i = 0; i < x.size(); ++i) {
+      long k = std::upper_bound(begin, begin + m, x(i)) - begin;
+      if (k == 0) {
+        res(i) = 0.0;
+        continue;
+      }
+      k = std::min(k, m - 1);
+      double w = (x(i) - grid_(k - 1)) / (grid_(k) - grid_(k - 1));
+      w = std::min(std::max(w, 0.0), 1.0);
+      res(i) = (1 - w) * cdf_(k - 1) + w * cdf_(k);
+    }
+    return res;
+  }
+
+private:
+  // unnormalized density of the continuous part (pdf_exact() returns the
+  // point mass at 0 for zero-inflated data)
+  Eigen::VectorXd continuous(const Eigen::VectorXd& x) const
+  {
+    Eigen::VectorXd xx = x;
+    if (fit_.get_prob0() > 0)
+      xx = (x.array() == 0).select(1e-10, x);
+    return fit_.pdf_exact(xx, data_);
+  }
+
+  const Kde1d& fit_;
+  const Eigen::VectorXd& data_;
+  double scale_{ 1.0 };
+  Eigen::VectorXd grid_, cdf_;
+};
+
+Result
+run_case(const Case& c, size_t n)
+{
+  // a copy, so that each sample starts with fresh distribution objects
+  std::mt19937 gen(static_cast<unsigned>(n));
+  Case draw_case = c;
+  Eigen::VectorXd data(n);
+  for (size_t i = 0; i < n; ++i)
+    data(static_cast<long>(i)) = draw_case.draw(gen);
+
+  Kde1d fit(c.xmin, c.xmax, c.type);
+  double fit_us = time_ns([&] { fit.fit(data); }, 1.0) / 1e3;
+  Reference ref(fit, data);
+
+  Result res;
+  res.name = c.name;
+  res.n = n;
+  res.fit_us = fit_us;
+
+  // evaluation points: equally spaced and the midpoints between the grid
+  // points of the model (where interpolation errors are largest); the
+  // levels for discrete data
+  Eigen::VectorXd grid = fit.get_grid_points();
+  long m = grid.size();
+  double lower = grid(0), upper = grid(m - 1);
+  Eigen::VectorXd x(2001 + m - 1);
+  x << Eigen::VectorXd::LinSpaced(2001, lower, upper),
+    0.5 * (grid.head(m - 1) + grid.tail(m - 1));
+  if (c.type == "d") {
+    lower = std::ceil(lower);
+    upper = std::floor(upper);
+    auto levels = static_cast<long>(upper - lower + 1);
+    x = Eigen::VectorXd::LinSpaced(levels, lower, upper);
+  }
+  auto points = static_cast<double>(x.size());
+  Eigen::VectorXd pdf, cdf;
+  res.model_ns = time_ns([&] { pdf = fit.pdf(x); }, points);
+  res.reference_ns = time_ns([&] { fit.pdf_exact(x, data); }, points);
+  cdf = fit.cdf(x);
+  Eigen::VectorXd pdf_ref = ref.get_pdf(x);
+  Eigen::VectorXd cdf_ref = ref.get_cdf(x);
+  if (c.type == "zi") {
+    // only the continuous part; the point mass is prob0 by construction
+    pdf = (x.array() == 0).select(0.0, pdf);
+    pdf_ref = (x.array() == 0).select(0.0, pdf_ref);
+  }
+
+  // errors in the bulk of the distribution; the outermost cells of the grid
+  // are approximated by design (the estimate is interpolated towards a
+  // boundary and has Gaussian tails beyond the grid), so the pdf error there
+  // is only reported
+  auto bulk = (cdf_ref.array() >= 0.001) && (cdf_ref.array() <= 0.999) &&
+              (x.array() > grid(1)) && (x.array() < grid(m - 2));
+  auto bulk_size = static_cast<double>(bulk.count());
+  Eigen::ArrayXd pdf_err = (pdf - pdf_ref).array().abs() / pdf_ref.maxCoeff();
+  Eigen::ArrayXd cdf_err = (cdf - cdf_ref).array().abs();
+  res.pdf_tails = pdf_err.maxCoeff();
+  pdf_err = bulk.select(pdf_err, 0.0);
+  cdf_err = bulk.select(cdf_err, 0.0);
+  res.pdf_max = pdf_err.maxCoeff();
+  res.pdf_mean = pdf_err.sum() / bulk_size;
+  res.cdf_max = cdf_err.maxCoeff();
+  res.cdf_mean = cdf_err.sum() / bulk_size;
+
+  // quantiles on the probability scale
+  Eigen::VectorXd p = Eigen::VectorXd::LinSpaced(999, 0.001, 0.999);
+  Eigen::VectorXd q = fit.quantile(p);
+  Eigen::ArrayXd q_err;
+  if (c.type == "c") {
+    q_err = (ref.get_cdf(q) - p).array().abs();
+  } else {
+    // with point masses, the quantile satisfies F(q-) < p <= F(q)
+    double step = (c.type == "d") ? 1.0 : 1e-9;
+    Eigen::VectorXd below = ref.get_cdf(q.array() - step);
+    Eigen::VectorXd at = ref.get_cdf(q);
+    q_err = (p - at).cwiseMax(below - p).cwiseMax(0.0).array();
+  }
+  res.q_max = q_err.maxCoeff();
+  res.q_mean = q_err.mean();
+
+  return res;
+}
+
+} // end anonymous namespace
+
+int
+main(int argc, char** argv)
+{
+  auto max_n = static_cast<size_t>(
+    std::stod(bench::get_flag(argc, argv, "max_n", "10000")));
+  std::string out = bench::get_flag(argc, argv, "benchmark_out", "");
+
+  std::cout << std::left << std::setw(16) << "case" << std::right
+            << std::setw(8) << "n" << std::setw(10) << "pdf max"
+            << std::setw(10) << "pdf mean" << std::setw(10) << "cdf max"
+            << std::setw(10) << "cdf mean" << std::setw(10) << "q max"
+            << std::setw(10) << "q mean" << std::setw(10) << "pdf tails"
+            << std::setw(11) << "fit [us]"
+            << std::setw(10) << "pdf [ns]" << std::setw(10) << "ref [ns]"
+            << std::endl;
+  std::vector<Result> results;
+  bool failed = false;
+  for (const auto& c : cases()) {
+    for (size_t n = 100; n <= max_n; n *= 10) {
+      Result r = run_case(c, n);
+      Thresholds thresholds(n);
+      results.push_back(r);
+      bool ok = (r.pdf_max <= thresholds.pdf) &&
+                (r.cdf_max <= thresholds.cdf) &&
+                (r.q_max <= thresholds.quantile);
+      failed = failed || !ok;
+      std::cout << std::left << std::setw(16) << r.name << std::right
+                << std::setw(8) << r.n << std::scientific
+                << std::setprecision(1) << std::setw(10) << r.pdf_max
+                << std::setw(10) << r.pdf_mean << std::setw(10) << r.cdf_max
+                << std::setw(10) << r.cdf_mean << std::setw(10) << r.q_max
+                << std::setw(10) << r.q_mean << std::setw(10) << r.pdf_tails
+                << std::fixed
+                << std::setprecision(0) << std::setw(11) << r.fit_us
+                << std::setw(10) << r.model_ns << std::setw(10)
+                << r.reference_ns << (ok ? "" : "  FAILED") << std::endl;
+    }
+  }
+
+  if (!out.empty()) {
+    // same layout as the benchmarks, with the errors as counters
+    std::ofstream file(out);
+    file << "{\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+      const Result& r = results[i];
+      file << (i ? ",\n" : "\n") << "    {\n"
+           << "      \"name\": \"accuracy/" << r.name << "/n:" << r.n
+           << "\",\n"
+           << "      \"run_type\": \"iteration\",\n"
+           << "      \"iterations\": 1,\n"
+           << std::defaultfloat << std::setprecision(10)
+           << "      \"real_time\": " << r.fit_us * 1e3 << ",\n"
+           << "      \"cpu_time\": " << r.fit_us * 1e3 << ",\n"
+           << "      \"time_unit\": \"ns\",\n"
+           << std::setprecision(6) << std::scientific
+           << "      \"pdf_max_error\": " << r.pdf_max << ",\n"
+           << "      \"pdf_mean_error\": " << r.pdf_mean << ",\n"
+           << "      \"cdf_max_error\": " << r.cdf_max << ",\n"
+           << "      \"cdf_mean_error\": " << r.cdf_mean << ",\n"
+           << "      \"quantile_max_error\": " << r.q_max << ",\n"
+           << "      \"quantile_mean_error\": " << r.q_mean << ",\n"
+           << "      \"pdf_tails_max_error\": " << r.pdf_tails << ",\n"
+           << std::fixed << std::setprecision(1)
+           << "      \"pdf_ns_per_point\": " << r.model_ns << ",\n"
+           << "      \"reference_ns_per_point\": " << r.reference_ns
+           << "\n    }";
+    }
+    file << "\n  ]\n}\n";
+  }
+
+  if (failed)
+    std::cout << "accuracy thresholds exceeded" << std::endl;
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,271 @@
+// Benchmarks for kde1d.
+//
+// Usage (see bench::run() for all flags):
+//   bench [--max_n=1000000] [--benchmark_filter=<regex>]
+//         [--benchmark_out=<file.json>] [--benchmark_repetitions=<n>]
+//
+// Benchmark names are paths like `fit/continuous/left/deg:2/unweighted/n:1000`,
+// so that groups can be selected by regular expressions. Sample sizes range
+// from 1e2 to `max_n` (at most 1e8) in powers of 10.
+
+#include "../include/kde1d.hpp"
+#include "harness.hpp"
+
+using namespace kde1d;
+
+namespace {
+
+struct Boundary
+{
+  std::string name;
+  double xmin;
+  double xmax;
+};
+
+const std::vector<Boundary> boundaries = { { "unbounded", NAN, NAN },
+                                           { "left", 0.0, NAN },
+                                           { "right", NAN, 0.0 },
+                                           { "both", 0.0, 1.0 } };
+const std::vector<std::string> types = { "continuous",
+                                         "discrete",
+                                         "zero-inflated" };
+
+// discrete data are rounded after scaling (the boundaries accordingly)
+double
+scale(const std::string& type)
+{
+  return (type == "discrete") ? 10.0 : 1.0;
+}
+
+// standard normal, exponential, negative exponential or uniform data,
+// depending on the boundaries
+Eigen::VectorXd
+simulate_data(const std::string& type, const Boundary& boundary, size_t n)
+{
+  Eigen::VectorXd u = stats::simulate_uniform(n, { 1 });
+  Eigen::VectorXd x;
+  if (boundary.name == "unbounded") {
+    x = stats::qnorm(u);
+  } else if (boundary.name == "left") {
+    x = -u.array().log();
+  } else if (boundary.name == "right") {
+    x = u.array().log();
+  } else {
+    x = u;
+  }
+
+  if (type == "discrete")
+    x = (scale(type) * x).array().round();
+  if (type == "zero-inflated")
+    x.head(n / 4).setZero();
+  return x;
+}
+
+Eigen::VectorXd
+simulate_weights(size_t n)
+{
+  return stats::simulate_uniform(n, { 2 }).array() + 0.5;
+}
+
+std::string
+n_str(size_t n)
+{
+  return "n:" + std::to_string(n);
+}
+
+std::vector<size_t>
+sample_sizes(size_t max_n)
+{
+  std::vector<size_t> res;
+  for (size_t n = 100; n <= std::min(max_n, size_t(100000000)); n *= 10)
+    res.push_back(n);
+  return res;
+}
+
+// fit for all variable types, boundaries, degrees, and with/without weights
+void
+register_fit(size_t max_n)
+{
+  for (const auto& type : types) {
+    for (const auto& b : boundaries) {
+      for (size_t degree = 0; degree < 3; ++degree) {
+        for (bool weighted : { false, true }) {
+          for (size_t n : sample_sizes(max_n)) {
+            std::string name = "fit/" + type + "/" + b.name +
+                               "/deg:" + std::to_string(degree) + "/" +
+                               (weighted ? "weighted/" : "unweighted/") +
+                               n_str(n);
+            bench::register_benchmark(name, [=](bench::State& state) {
+              Eigen::VectorXd x = simulate_data(type, b, n);
+              Eigen::VectorXd w;
+              if (weighted)
+                w = simulate_weights(n);
+              double s = scale(type);
+              while (state.keep_running()) {
+                Kde1d fit(b.xmin * s, b.xmax * s, type, 1, NAN, degree);
+                fit.fit(x, w);
+                bench::do_not_optimize(fit);
+              }
+              state.set_items_per_iteration(static_cast<double>(n));
+            });
+          }
+        }
+      }
+    }
+  }
+}
+
+// throughput (large batches, in random or ascending order) and latency
+// (single points) of the evaluation functions
+void
+register_eval()
+{
+  const size_t n = 10000;
+  for (const auto& type : types) {
+    for (const auto& b : { boundaries[0], boundaries[1] }) {
+      for (std::string what :
+           { "pdf",
+             "logpdf",
+             "cdf",
+             "pdf_cdf",
+             "quantile",
+             "simulate",
+             "simulate_into",
+             "simulate_sobol" }) {
+        for (size_t batch : { size_t(1), size_t(100000) }) {
+          for (bool sorted : { false, true }) {
+            if (sorted && (batch == 1))
+              continue;
+            std::string name = what + "/" + type + "/" + b.name +
+                               "/batch:" + std::to_string(batch) +
+                               (sorted ? "/sorted" : "");
+            bench::register_benchmark(name, [=](bench::State& state) {
+              double s = scale(type);
+              Kde1d fit(b.xmin * s, b.xmax * s, type);
+              fit.fit(simulate_data(type, b, n));
+              Eigen::VectorXd u = stats::simulate_uniform(batch, { 3 });
+              if (sorted)
+                std::sort(u.data(), u.data() + u.size());
+              Eigen::VectorXd x = fit.quantile(u);
+              Eigen::MatrixXd buffers(batch, 2);
+              while (state.keep_running()) {
+                Eigen::VectorXd res;
+                if (what == "pdf") {
+                  res = fit.pdf(x);
+                } else if (what == "logpdf") {
+                  res = fit.logpdf(x);
+                } else if (what == "cdf") {
+                  res = fit.cdf(x);
+                } else if (what == "pdf_cdf") {
+                  fit.pdf_cdf(x, buffers.col(0), buffers.col(1));
+                  bench::do_not_optimize(buffers);
+                } else if (what == "quantile") {
+                  res = fit.quantile(u);
+                } else if (what == "simulate") {
+                  res = fit.simulate(batch, { 4 });
+                } else if (what == "simulate_into") {
+                  fit.simulate_into(buffers.col(0), 4);
+                  bench::do_not_optimize(buffers);
+                } else {
+                  res = fit.simulate(batch, SequenceType::scrambled_sobol, 4);
+                }
+                bench::do_not_optimize(res);
+              }
+              state.set_items_per_iteration(static_cast<double>(batch));
+            });
+          }
+        }
+      }
+    }
+  }
+}
+
+// bandwidth selection alone (on standard normal data)
+void
+register_bandwidth(size_t max_n)
+{
+  for (std::string method : { "plugin", "lscv", "sj" }) {
+    for (size_t degree = 0; degree < 3; ++degree) {
+      for (size_t n : sample_sizes(max_n)) {
+        std::string name = "bandwidth/" + method +
+                           "/deg:" + std::to_string(degree) + "/" + n_str(n);
+        bench::register_benchmark(name, [=](bench::State& state) {
+          Eigen::VectorXd x = simulate_data("continuous", boundaries[0], n);
+          while (state.keep_running()) {
+            bandwidth::PluginBandwidthSelector selector(x);
+            double bw;
+            if (method == "plugin") {
+              bw = selector.select_bandwidth(degree);
+            } else if (method == "lscv") {
+              bw = selector.select_bandwidth_lscv(degree);
+            } else {
+              bw = selector.select_bandwidth_sj(degree);
+            }
+            bench::do_not_optimize(bw);
+          }
+          state.set_items_per_iteration(static_cast<double>(n));
+        });
+      }
+    }
+  }
+}
+
+// binned estimates of the density and its first two derivatives on the
+// default grid (binning and FFT)
+void
+register_fft(size_t max_n)
+{
+  for (size_t n : sample_sizes(max_n)) {
+    bench::register_benchmark("fft/" + n_str(n), [=](bench::State& state) {
+      Eigen::VectorXd x = simulate_data("continuous", boundaries[0], n);
+      double bw = 1.06 * std::pow(static_cast<double>(n), -0.2);
+      while (state.keep_running()) {
+        fft::KdeFFT kde(x, bw, x.minCoeff(), x.maxCoeff());
+        Eigen::MatrixXd res = kde.kde_drvs(2);
+        bench::do_not_optimize(res);
+      }
+      state.set_items_per_iteration(static_cast<double>(n));
+    });
+  }
+}
+
+// direct evaluation against binning and FFT for small samples; `fit_lp()`
+// switches to the FFT above `n * grid size = 4e4`
+void
+register_crossover()
+{
+  for (std::string method : { "direct", "fft" }) {
+    for (size_t n : { 10, 25, 50, 100, 200, 500, 1000 }) {
+      std::string name = "crossover/" + method + "/" + n_str(n);
+      bench::register_benchmark(name, [=](bench::State& state) {
+        Eigen::VectorXd x = simulate_data("continuous", boundaries[0], n);
+        double bw = 1.06 * std::pow(static_cast<double>(n), -0.2);
+        double lower = x.minCoeff() - 4 * bw, upper = x.maxCoeff() + 4 * bw;
+        while (state.keep_running()) {
+          Eigen::MatrixXd res;
+          if (method == "direct") {
+            res = direct::KdeDirect(x, bw, lower, upper).kde_drvs(2);
+          } else {
+            res = fft::KdeFFT(x, bw, lower, upper).kde_drvs(2);
+          }
+          bench::do_not_optimize(res);
+        }
+      });
+    }
+  }
+}
+
+} // end anonymous namespace
+
+int
+main(int argc, char** argv)
+{
+  auto max_n = static_cast<size_t>(
+    std::stod(bench::get_flag(argc, argv, "max_n", "1000000")));
+  register_fit(max_n);
+  register_eval();
+  register_bandwidth(max_n);
+  register_fft(max_n);
+  register_crossover();
+  return bench::run(argc, argv);
+}
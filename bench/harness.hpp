@@ -0,0 +1,341 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+//! A minimal benchmark harness.
+//!
+//! Mimics the interface and the JSON output of Google Benchmark, so that its
+//! tools (e.g., `compare.py`) can be used to track regressions across
+//! commits, but has no dependencies. Only the time spent in the
+//! `while (state.keep_running())` loop of a benchmark is measured; the setup
+//! before the loop is excluded.
+namespace bench {
+
+//! passed to each benchmark; controls the number of iterations and collects
+//! counters.
+class State
+{
+public:
+  explicit State(size_t iterations)
+    : iterations_(iterations)
+  {}
+
+  //! returns true as long as there are iterations left; the timer starts
+  //! with the first call and stops when it returns false.
+  bool keep_running()
+  {
+    if (done_ == 0) {
+      start_real_ = std::chrono::steady_clock::now();
+      start_cpu_ = std::clock();
+    }
+    if (done_ < iterations_) {
+      ++done_;
+      return true;
+    }
+    real_time_ = std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start_real_)
+                   .count();
+    cpu_time_ =
+      static_cast<double>(std::clock() - start_cpu_) / CLOCKS_PER_SEC;
+    return false;
+  }
+
+  //! number of items (e.g., evaluation points) processed per iteration;
+  //! reported as `items_per_second`.
+  void set_items_per_iteration(double items) { items_ = items; }
+
+  //! skips the benchmark with a message (e.g., when the input is invalid).
+  void skip_with_error(const std::string& msg) { error_ = msg; }
+
+  size_t iterations() const { return iterations_; }
+  double real_time() const { return real_time_; }
+  double cpu_time() const { return cpu_time_; }
+  double items() const { return items_; }
+  const std::string& error() const { return error_; }
+
+private:
+  size_t iterations_;
+  size_t done_{ 0 };
+  std::chrono::steady_clock::time_point start_real_;
+  std::clock_t start_cpu_{ 0 };
+  double real_time_{ 0.0 };
+  double cpu_time_{ 0.0 };
+  double items_{ 0.0 };
+  std::string error_;
+};
+
+namespace detail {
+inline const void* volatile sink = nullptr;
+}
+
+//! prevents the compiler from optimizing away a computed value (its address
+//! escapes to a global).
+template<class T>
+inline void
+do_not_optimize(const T& value)
+{
+  detail::sink = &value;
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+
+struct Benchmark
+{
+  std::string name;
+  std::function<void(State&)> fn;
+};
+
+inline std::vector<Benchmark>&
+registry()
+{
+  static std::vector<Benchmark> benchmarks;
+  return benchmarks;
+}
+
+inline void
+register_benchmark(const std::string& name, std::function<void(State&)> fn)
+{
+  registry().push_back({ name, std::move(fn) });
+}
+
+//! a single measurement (or an aggregate over repetitions).
+struct Run
+{
+  std::string name;
+  std::string run_name;
+  std::string aggregate;
+  size_t iterations;
+  double real_time; // ns per iteration
+  double cpu_time;  // ns per iteration
+  double items_per_second;
+  std::string error;
+};
+
+//! runs one benchmark, increasing the number of iterations until the
+//! measured time exceeds `min_time` seconds.
+inline Run
+run_one(const Benchmark& b, double min_time)
+{
+  size_t iterations = 1;
+  while (true) {
+    State state(iterations);
+    b.fn(state);
+    if (!state.error().empty())
+      return { b.name, b.name, "", 0, 0.0, 0.0, 0.0, state.error() };
+    double t = state.real_time();
+    if ((t >= min_time) || (iterations >= 1000000000)) {
+      double it = static_cast<double>(iterations);
+      double ips = (state.items() > 0) ? state.items() * it / t : 0.0;
+      double cpu = state.cpu_time() / it * 1e9;
+      return { b.name, b.name, "", iterations, t / it * 1e9, cpu, ips, "" };
+    }
+    // aim 40% above the target to avoid another round (as Google Benchmark)
+    double factor = (t > 0) ? 1.4 * min_time / t : 100.0;
+    factor = std::min(std::max(factor, 2.0), 100.0);
+    iterations = static_cast<size_t>(static_cast<double>(iterations) * factor);
+  }
+}
+
+//! mean, median and standard deviation over repetitions.
+inline std::vector<Run>
+aggregate(const std::vector<Run>& runs)
+{
+  auto stat = [&runs](const std::string& what, double Run::*field) {
+    std::vector<double> v;
+    for (const auto& r : runs)
+      v.push_back(r.*field);
+    double n = static_cast<double>(v.size());
+    double mean = 0.0;
+    for (double x : v)
+      mean += x / n;
+    if (what == "mean")
+      return mean;
+    if (what == "median") {
+      std::sort(v.begin(), v.end());
+      size_t k = v.size() / 2;
+      return (v.size() % 2) ? v[k] : 0.5 * (v[k - 1] + v[k]);
+    }
+    double ss = 0.0;
+    for (double x : v)
+      ss += (x - mean) * (x - mean);
+    return std::sqrt(ss / std::max(n - 1.0, 1.0));
+  };
+
+  std::vector<Run> res;
+  for (std::string what : { "mean", "median", "stddev" }) {
+    Run r = runs[0];
+    r.name = r.run_name + "_" + what;
+    r.aggregate = what;
+    r.real_time = stat(what, &Run::real_time);
+    r.cpu_time = stat(what, &Run::cpu_time);
+    r.items_per_second = stat(what, &Run::items_per_second);
+    res.push_back(r);
+  }
+  return res;
+}
+
+inline std::string
+json_escape(const std::string& s)
+{
+  std::string res;
+  for (char c : s) {
+    if ((c == '"') || (c == '\\'))
+      res += '\\';
+    res += c;
+  }
+  return res;
+}
+
+inline void
+write_json(std::ostream& os,
+           const std::vector<Run>& runs,
+           const std::string& executable)
+{
+  std::time_t now = std::time(nullptr);
+  char date[64];
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+#ifdef NDEBUG
+  const char* build_type = "release";
+#else
+  const char* build_type = "debug";
+#endif
+
+  os << "{\n  \"context\": {\n";
+  os << "    \"date\": \"" << date << "\",\n";
+  os << "    \"executable\": \"" << json_escape(executable) << "\",\n";
+  os << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+  os << "    \"library_build_type\": \"" << build_type << "\"\n";
+  os << "  },\n  \"benchmarks\": [";
+  os << std::setprecision(10);
+  for (size_t i = 0; i < runs.size(); ++i) {
+    const Run& r = runs[i];
+    os << (i ? ",\n" : "\n") << "    {\n";
+    os << "      \"name\": \"" << json_escape(r.name) << "\",\n";
+    os << "      \"run_name\": \"" << json_escape(r.run_name) << "\",\n";
+    if (!r.error.empty()) {
+      os << "      \"error_occurred\": true,\n";
+      os << "      \"error_message\": \"" << json_escape(r.error) << "\"\n";
+      os << "    }";
+      continue;
+    }
+    if (r.aggregate.empty()) {
+      os << "      \"run_type\": \"iteration\",\n";
+    } else {
+      os << "      \"run_type\": \"aggregate\",\n";
+      os << "      \"aggregate_name\": \"" << r.aggregate << "\",\n";
+    }
+    os << "      \"iterations\": " << r.iterations << ",\n";
+    os << "      \"real_time\": " << r.real_time << ",\n";
+    os << "      \"cpu_time\": " << r.cpu_time << ",\n";
+    os << "      \"time_unit\": \"ns\"";
+    if (r.items_per_second > 0)
+      os << ",\n      \"items_per_second\": " << r.items_per_second;
+    os << "\n    }";
+  }
+  os << "\n  ]\n}\n";
+}
+
+inline void
+write_console(std::ostream& os, const Run& r)
+{
+  os << std::left << std::setw(56) << r.name << std::right;
+  if (!r.error.empty()) {
+    os << " ERROR: " << r.error << std::endl;
+    return;
+  }
+  auto fmt = [](double ns) {
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(ns < 1e4 ? 1 : 0);
+    if (ns < 1e4)
+      ss << ns << " ns";
+    else if (ns < 1e7)
+      ss << ns / 1e3 << " us";
+    else
+      ss << ns / 1e6 << " ms";
+    return ss.str();
+  };
+  os << std::setw(14) << fmt(r.real_time) << std::setw(14) << fmt(r.cpu_time)
+     << std::setw(12) << r.iterations;
+  if (r.items_per_second > 0)
+    os << "  items/s=" << std::setprecision(4) << r.items_per_second;
+  os << std::endl;
+}
+
+//! parses `--name=value` arguments; returns `def` if absent.
+inline std::string
+get_flag(int argc, char** argv, const std::string& name, std::string def)
+{
+  std::string prefix = "--" + name + "=";
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg.compare(0, prefix.size(), prefix) == 0)
+      def = arg.substr(prefix.size());
+  }
+  return def;
+}
+
+//! runs all registered benchmarks whose name matches the filter.
+//!
+//! Recognized flags (as in Google Benchmark):
+//! `--benchmark_filter=<regex>`, `--benchmark_min_time=<seconds>`,
+//! `--benchmark_repetitions=<n>`, `--benchmark_format=<console|json>`,
+//! `--benchmark_out=<file>` (always JSON), and `--benchmark_list_tests=true`.
+inline int
+run(int argc, char** argv)
+{
+  std::regex filter(get_flag(argc, argv, "benchmark_filter", ".*"));
+  double min_time =
+    std::stod(get_flag(argc, argv, "benchmark_min_time", "0.1"));
+  size_t reps = std::stoul(get_flag(argc, argv, "benchmark_repetitions", "1"));
+  std::string format = get_flag(argc, argv, "benchmark_format", "console");
+  std::string out = get_flag(argc, argv, "benchmark_out", "");
+  bool list = get_flag(argc, argv, "benchmark_list_tests", "false") == "true";
+
+  // console output goes to stderr if stdout receives JSON
+  std::ostream& console = (format == "json") ? std::cerr : std::cout;
+  std::vector<Run> runs;
+  for (const auto& b : registry()) {
+    if (!std::regex_search(b.name, filter))
+      continue;
+    if (list) {
+      std::cout << b.name << std::endl;
+      continue;
+    }
+    std::vector<Run> reps_runs;
+    for (size_t k = 0; k < std::max(reps, size_t(1)); ++k) {
+      reps_runs.push_back(run_one(b, min_time));
+      write_console(console, reps_runs.back());
+      if (!reps_runs.back().error.empty())
+        break;
+    }
+    runs.insert(runs.end(), reps_runs.begin(), reps_runs.end());
+    if ((reps_runs.size() > 1) && reps_runs[0].error.empty()) {
+      for (const auto& r : aggregate(reps_runs)) {
+        write_console(console, r);
+        runs.push_back(r);
+      }
+    }
+  }
+
+  if (format == "json")
+    write_json(std::cout, runs, argv[0]);
+  if (!out.empty()) {
+    std::ofstream file(out);
+    write_json(file, runs, argv[0]);
+  }
+  return 0;
+}
+
+} // end bench
@@ -0,0 +1,152 @@
+// Large-sample stress test of the fitting pipeline (POSIX only).
+//
+// Usage:
+//   stress [--n=2147483649] [--type=c] [--file=<path>] [--keep=false]
+//
+// Writes n observations to a file (standard normal draws for type "c",
+// rounded normal draws with mean 10 and standard deviation 3 for type "d"),
+// memory-maps it, and fits a model directly on the mapping. The default
+// sample size exceeds 2^31, so any 32-bit index in the pipeline shows up as
+// a wrong number of observations, a crash, or a wrong estimate. The fit
+// needs about 16 bytes per observation in addition to the mapped file
+// (which needs another 8), so the default size requires a machine with
+// about 64 GB of memory. The program exits with status 1 if a check fails.
+
+#include "../include/kde1d.hpp"
+#include "harness.hpp"
+#include <fcntl.h>
+#include <random>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace kde1d;
+
+namespace {
+
+//! a read-only memory mapping of a file of doubles.
+class MappedData
+{
+public:
+  MappedData(const std::string& path, int64_t n)
+    : bytes_(static_cast<size_t>(n) * sizeof(double))
+  {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("cannot open " + path);
+    data_ = ::mmap(nullptr, bytes_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data_ == MAP_FAILED)
+      throw std::runtime_error("cannot map " + path);
+  }
+
+  ~MappedData() { ::munmap(data_, bytes_); }
+  MappedData(const MappedData&) = delete;
+  MappedData& operator=(const MappedData&) = delete;
+
+  Eigen::Map<const Eigen::VectorXd> vector() const
+  {
+    return Eigen::Map<const Eigen::VectorXd>(
+      static_cast<const double*>(data_),
+      static_cast<Eigen::Index>(bytes_ / sizeof(double)));
+  }
+
+private:
+  size_t bytes_;
+  void* data_;
+};
+
+//! writes the data in chunks, so that it never has to fit into memory.
+void
+write_data(const std::string& path, int64_t n, const std::string& type)
+{
+  std::ofstream file(path, std::ios::binary);
+  if (!file)
+    throw std::runtime_error("cannot create " + path);
+  std::mt19937_64 gen(1);
+  std::normal_distribution<double> normal;
+  std::vector<double> chunk(1 << 20);
+  for (int64_t i = 0; i < n;) {
+    auto len = std::min(static_cast<int64_t>(chunk.size()), n - i);
+    for (int64_t k = 0; k < len; ++k) {
+      double z = normal(gen);
+      chunk[static_cast<size_t>(k)] =
+        (type == "c") ? z : std::max(std::round(10.0 + 3.0 * z), 0.0);
+    }
+    file.write(reinterpret_cast<const char*>(chunk.data()),
+               static_cast<std::streamsize>(len * sizeof(double)));
+    i += len;
+  }
+  if (!file)
+    throw std::runtime_error("cannot write " + path);
+}
+
+double
+peak_rss_gb()
+{
+  struct rusage usage;
+  ::getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return static_cast<double>(usage.ru_maxrss) / 1e9;
+#else
+  return static_cast<double>(usage.ru_maxrss) / 1e6;
+#endif
+}
+
+double
+seconds_since(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+    .count();
+}
+
+} // end anonymous namespace
+
+int
+main(int argc, char** argv)
+{
+  auto n = static_cast<int64_t>(
+    std::stod(bench::get_flag(argc, argv, "n", "2147483649")));
+  std::string type = bench::get_flag(argc, argv, "type", "c");
+  std::string path =
+    bench::get_flag(argc, argv, "file", "/tmp/kde1d_stress.bin");
+  bool keep = bench::get_flag(argc, argv, "keep", "false") == "true";
+  if ((type != "c") && (type != "d"))
+    throw std::invalid_argument("type must be 'c' or 'd'");
+
+  auto start = std::chrono::steady_clock::now();
+  write_data(path, n, type);
+  std::cout << "wrote " << n << " observations in " << seconds_since(start)
+            << " s" << std::endl;
+
+  bool ok = true;
+  {
+    MappedData data(path, n);
+    Kde1d fit(NAN, NAN, type);
+    fit.set_binned_stats(true);
+    start = std::chrono::steady_clock::now();
+    fit.fit(data.vector());
+    std::cout << "fitted in " << seconds_since(start) << " s, peak RSS "
+              << peak_rss_gb() << " GB" << std::endl;
+
+    // the median is 0 (10) and the log-likelihood per observation is about
+    // minus the entropy of the standard (rounded) normal distribution
+    double median = fit.quantile(Eigen::VectorXd::Constant(1, 0.5))(0);
+    double loglik = fit.get_loglik() / static_cast<double>(n);
+    double median_target = (type == "c") ? 0.0 : 10.0;
+    double loglik_target = -0.5 * std::log(2 * M_PI * M_E);
+    if (type == "d")
+      loglik_target -= std::log(3.0);
+    std::cout << "bandwidth " << fit.get_bandwidth() << ", median " << median
+              << ", loglik per observation " << loglik << ", edf "
+              << fit.get_edf() << std::endl;
+    ok = (std::fabs(median - median_target) < 0.1) &&
+         (std::fabs(loglik - loglik_target) < 0.01) && (fit.get_edf() > 0);
+  }
+
+  if (!keep)
+    std::remove(path.c_str());
+  std::cout << (ok ? "passed" : "FAILED") << std::endl;
+  return ok ? 0 : 1;
+}
@@ -3,12 +3,21 @@ target_include_directories(kde1d INTERFACE
         $<BUILD_INTERFACE:${PROJECT_SOURCE_DIR}/include>
         $<INSTALL_INTERFACE:include>
         )
+target_link_libraries(kde1d INTERFACE Threads::Threads)
 
 if(BUILD_TESTING)
+    # Boost is only used by the unit tests
+    find_package(Boost 1.56 REQUIRED)
     set(EXECUTABLE_OUTPUT_PATH ${PROJECT_BINARY_DIR}/bin)
+    enable_testing()
     add_subdirectory(test)
 endif(BUILD_TESTING)
 
+if(BUILD_BENCHMARKS)
+    set(EXECUTABLE_OUTPUT_PATH ${PROJECT_BINARY_DIR}/bin)
+    add_subdirectory(bench)
+endif(BUILD_BENCHMARKS)
+
 # Related to exports for linux/mac and code coverage
 ####
 # Installation
@@ -1,7 +1,7 @@
 find_package(Eigen3                       REQUIRED)
-find_package(Boost 1.56                   REQUIRED)
+find_package(Threads                      REQUIRED)
 
-set(external_includes ${EIGEN3_INCLUDE_DIR} ${Boost_INCLUDE_DIRS})
+set(external_includes ${EIGEN3_INCLUDE_DIR})
 
 # Find doxygen and configure if found
 find_package(Doxygen QUIET)
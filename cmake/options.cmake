@@ -8,4 +8,5 @@ endif()
 option(WARNINGS_AS_ERRORS        "Compiler warnings as errors"       "OFF")
 option(OPT_ASAN                  "Use adress sanitizer (debug)"      "ON")
 option(BUILD_TESTING             "Build tests."                      "ON")
+option(BUILD_BENCHMARKS          "Build benchmarks."                 "OFF")
 option(CODE_COVERAGE             "Code coverage."                    "OFF")
\ No newline at end of file
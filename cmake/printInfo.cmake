@@ -13,5 +13,6 @@ message( STATUS "CMAKE_CXX_FLAGS_DEBUG=         ${CMAKE_CXX_FLAGS_DEBUG}")
 message( STATUS "CMAKE_CXX_FLAGS_RELEASE=       ${CMAKE_CXX_FLAGS_RELEASE}")
 message( STATUS )
 message( STATUS "BUILD_TESTING=                 ${BUILD_TESTING}")
+message( STATUS "BUILD_BENCHMARKS=              ${BUILD_BENCHMARKS}")
 message( STATUS "CODE_COVERAGE=                 ${CODE_COVERAGE}")
 message( STATUS )
\ No newline at end of file
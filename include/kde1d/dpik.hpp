@@ -3,6 +3,7 @@
 #include "kdefft.hpp"
 #include "stats.hpp"
 #include <cmath>
+#include <map>
 
 namespace kde1d {
 
@@ -12,6 +13,26 @@ namespace bandwidth {
 static constexpr double M_PI = 3.141592653589793;
 #endif
 
+//! Summary of a bandwidth selection that can be used to warm-start the
+//! selection on similar data.
+struct WarmStart
+{
+  //! selected bandwidth.
+  double bandwidth{ NAN };
+  //! solution for the local constant estimator (LSCV and SJ only).
+  double local_constant_bandwidth{ NAN };
+  //! pilot bandwidths for the kernel functionals, keyed by derivative order.
+  std::map<unsigned, double> pilot_bandwidths;
+  //! scale estimate of the data.
+  double scale{ NAN };
+  //! effective sample size.
+  double n{ NAN };
+  //! range and counts of the bins.
+  double lower{ NAN };
+  double upper{ NAN };
+  Eigen::VectorXd bin_counts;
+};
+
 //! Bandwidth selection for local-likelihood density estimation.
 //! Methodology is similar to Sheather and Jones(1991), but asymptotic
 //! bias/variance expressions are adapted for higher-order polynomials and
@@ -20,37 +41,109 @@ class PluginBandwidthSelector
 {
 public:
   PluginBandwidthSelector(const Eigen::VectorXd& x,
-                          const Eigen::VectorXd& weights = Eigen::VectorXd());
+                          const Eigen::VectorXd& weights = Eigen::VectorXd(),
+                          const WarmStart& warm_start = WarmStart(),
+                          const Kernel& kernel = Kernel());
+  PluginBandwidthSelector(const stats::JitteredLevels& x,
+                          const WarmStart& warm_start = WarmStart(),
+                          const Kernel& kernel = Kernel());
   double select_bandwidth(size_t degree);
+  double select_bandwidth_lscv(size_t degree);
+  double select_bandwidth_sj(size_t degree);
+  bool is_close_to_warm_start(double tol) const;
+  WarmStart get_state() const { return state_; }
 
 private:
   double scale_est(const Eigen::VectorXd& x);
+  double scale_est(const stats::JitteredLevels& x);
+  static double robust_scale(double sd, const Eigen::VectorXd& quartiles);
+  void init_state(double lower, double upper);
   double get_bandwidth_for_bkfe(unsigned drv);
   double ll_ibias2(size_t degree);
   double ll_ivar(size_t degree);
+  double bkfe(unsigned drv, double bandwidth);
+  double lscv(double bandwidth);
+  double finalize_local_constant(double bandwidth, size_t degree);
+  double degree_factor(size_t degree);
+  double effective_n() const;
+  double reference_bandwidth(size_t degree) const;
+  double kernel_factor() const;
 
   fft::KdeFFT kde_;
+  Kernel kernel_;
   Eigen::VectorXd weights_;
+  double nobs_;
   Eigen::VectorXd bin_counts_;
   double scale_;
+  WarmStart warm_start_;
+  WarmStart state_;
 };
 
 //! @param x vector of observations.
 //! @param weigths optional vector of weights for each observation.
+//! @param warm_start the state of a previous selection on similar data
+//!   (optional). Its scale estimate and pilot bandwidths are reused and the
+//!   search ranges of LSCV and SJ are narrowed around its solution.
+//! @param kernel the kernel function of the estimator. Kernel functionals
+//!   are always estimated with the Gaussian kernel; the selected bandwidths
+//!   are rescaled to `kernel`.
 inline PluginBandwidthSelector::PluginBandwidthSelector(
   const Eigen::VectorXd& x,
-  const Eigen::VectorXd& weights)
+  const Eigen::VectorXd& weights,
+  const WarmStart& warm_start,
+  const Kernel& kernel)
   : kde_(fft::KdeFFT(x, 0.0, x.minCoeff(), x.maxCoeff(), weights))
+  , kernel_(kernel)
   , weights_(weights)
+  , nobs_(static_cast<double>(x.size()))
+  , warm_start_(warm_start)
 {
-  if (weights.size() == 0) {
-    weights_ = Eigen::VectorXd::Ones(x.size());
+  // unit weights are represented by an empty vector
+  if (weights.size() > 0)
+    weights_ = weights_ * static_cast<double>(x.size()) / weights_.sum();
+
+  bin_counts_ = kde_.get_bin_counts();
+  if (std::isnan(warm_start_.scale)) {
+    scale_ = scale_est(x);
   } else {
-    weights_ = weights_ * x.size() / weights_.sum();
+    scale_ = warm_start_.scale;
   }
+  init_state(x.minCoeff(), x.maxCoeff());
+}
 
+//! @param x jittered discrete data (see `stats::JitteredLevels`).
+//! @param warm_start the state of a previous selection on similar data
+//!   (optional).
+//! @param kernel the kernel function of the estimator.
+inline PluginBandwidthSelector::PluginBandwidthSelector(
+  const stats::JitteredLevels& x,
+  const WarmStart& warm_start,
+  const Kernel& kernel)
+  : kde_(fft::KdeFFT(x, 0.0, x.min(), x.max()))
+  , kernel_(kernel)
+  , nobs_(static_cast<double>(x.size()))
+  , warm_start_(warm_start)
+{
   bin_counts_ = kde_.get_bin_counts();
-  scale_ = scale_est(x);
+  if (std::isnan(warm_start_.scale)) {
+    scale_ = scale_est(x);
+  } else {
+    scale_ = warm_start_.scale;
+  }
+  init_state(x.min(), x.max());
+}
+
+//! records the state of the selection for warm starts.
+//! @param lower the smallest observation.
+//! @param upper the largest observation.
+inline void
+PluginBandwidthSelector::init_state(double lower, double upper)
+{
+  state_.scale = scale_;
+  state_.n = effective_n();
+  state_.lower = lower;
+  state_.upper = upper;
+  state_.bin_counts = bin_counts_;
 }
 
 //! Scale estimate (minimum of standard deviation and robust equivalent)
@@ -58,16 +151,41 @@ inline PluginBandwidthSelector::PluginBandwidthSelector(
 inline double
 PluginBandwidthSelector::scale_est(const Eigen::VectorXd& x)
 {
-  double m_x = x.cwiseProduct(weights_).mean();
-  Eigen::VectorXd sx = (x - Eigen::VectorXd::Constant(x.size(), m_x));
-  double sd_x = std::sqrt(sx.cwiseAbs2().cwiseProduct(weights_).sum() /
-                          (static_cast<double>(x.size()) - 1));
+  double m_x, ss_x;
+  if (weights_.size() > 0) {
+    m_x = x.cwiseProduct(weights_).mean();
+    ss_x = ((x.array() - m_x).square() * weights_.array()).sum();
+  } else {
+    m_x = x.mean();
+    ss_x = (x.array() - m_x).square().sum();
+  }
+  double sd_x = std::sqrt(ss_x / (static_cast<double>(x.size()) - 1));
   Eigen::VectorXd q_x(2);
   q_x << 0.25, 0.75;
-  q_x = stats::quantile(x, q_x, weights_);
-  double scale = std::min((q_x(1) - q_x(0)) / 1.349, sd_x);
+  return robust_scale(sd_x, stats::quantile(x, q_x, weights_));
+}
+
+//! Scale estimate of jittered discrete data.
+//! @param x jittered discrete data.
+inline double
+PluginBandwidthSelector::scale_est(const stats::JitteredLevels& x)
+{
+  Eigen::VectorXd q_x(2);
+  q_x << 0.25, 0.75;
+  return robust_scale(x.sd(), x.quantile(q_x));
+}
+
+//! the minimum of the standard deviation and the normal-equivalent scale of
+//! the interquartile range (or a positive fallback).
+//! @param sd standard deviation.
+//! @param quartiles first and third quartile.
+inline double
+PluginBandwidthSelector::robust_scale(double sd,
+                                      const Eigen::VectorXd& quartiles)
+{
+  double scale = std::min((quartiles(1) - quartiles(0)) / 1.349, sd);
   if (scale == 0) {
-    scale = (sd_x > 0) ? sd_x : 1.0;
+    scale = (sd > 0) ? sd : 1.0;
   }
   return scale;
 }
@@ -82,8 +200,16 @@ PluginBandwidthSelector::get_bandwidth_for_bkfe(unsigned drv)
     throw std::invalid_argument("only even drv allowed.");
   }
 
-  // effective sample size
-  double n = std::pow(weights_.sum(), 2) / weights_.cwiseAbs2().sum();
+  double n = effective_n();
+
+  // reuse the pilot of a warm start (adjusted for the sample size)
+  auto warm_pilot = warm_start_.pilot_bandwidths.find(drv);
+  if (warm_pilot != warm_start_.pilot_bandwidths.end()) {
+    double pilot = warm_pilot->second;
+    pilot *= std::pow(warm_start_.n / n, 1.0 / (drv + 3));
+    state_.pilot_bandwidths[drv] = pilot;
+    return pilot;
+  }
 
   // start with normal reference rule (eq 3.7)
   int r = drv + 4;
@@ -101,7 +227,9 @@ PluginBandwidthSelector::get_bandwidth_for_bkfe(unsigned drv)
 
   Kr = stats::dnorm_drv(Eigen::VectorXd::Zero(1), r - 2)(0);
 
-  return std::pow(-2 * Kr / (psi * n), 1.0 / (r + 1));
+  double pilot = std::pow(-2 * Kr / (psi * n), 1.0 / (r + 1));
+  state_.pilot_bandwidths[drv] = pilot;
+  return pilot;
 }
 
 //! computes the integrated squared bias (without bandwidth and n terms).
@@ -131,8 +259,16 @@ PluginBandwidthSelector::ll_ibias2(size_t degree)
     arg = f4 - 3 * f2.cwiseAbs2().cwiseQuotient(f0) +
           2 * (f1.array().pow(4) / f0.array().pow(3)).matrix();
     arg = (0.125 * arg).cwiseAbs2().cwiseQuotient(f0);
+  } else if (degree == 3) {
+    // local cubic fits are equivalent to a fourth-order kernel
+    kde_.set_bandwidth(get_bandwidth_for_bkfe(8));
+    arg = kde_.kde_drv(8) / 64;
+  } else if (degree == 4) {
+    // local quartic fits are equivalent to a sixth-order kernel
+    kde_.set_bandwidth(get_bandwidth_for_bkfe(12));
+    arg = kde_.kde_drv(12) / 2304;
   } else {
-    throw std::invalid_argument("degree must be one of {0, 1, 2}.");
+    throw std::invalid_argument("degree must be one of {0, 1, 2, 3, 4}.");
   }
   return bin_counts_.cwiseProduct(arg).sum() / bin_counts_.sum();
 }
@@ -143,9 +279,15 @@ PluginBandwidthSelector::ll_ibias2(size_t degree)
 inline double
 PluginBandwidthSelector::ll_ivar(size_t degree)
 {
-  if (degree > 2)
-    throw std::invalid_argument("degree must be one of {0, 1, 2}.");
-  return (degree < 2 ? 1.0 : 27.0 / 16.0) * 0.5 / std::sqrt(M_PI);
+  if (degree > 4)
+    throw std::invalid_argument("degree must be one of {0, 1, 2, 3, 4}.");
+  double factor = 1.0;
+  if ((degree == 2) || (degree == 3)) {
+    factor = 27.0 / 16.0;
+  } else if (degree == 4) {
+    factor = 2265.0 / 1024.0;
+  }
+  return factor * 0.5 / std::sqrt(M_PI);
 }
 
 //! Selects the bandwidth for kernel density estimation.
@@ -153,25 +295,251 @@ PluginBandwidthSelector::ll_ivar(size_t degree)
 inline double
 PluginBandwidthSelector::select_bandwidth(size_t degree)
 {
-  // effective sample size
-  double n = std::pow(weights_.sum(), 2) / weights_.cwiseAbs2().sum();
+  double n = effective_n();
   double bandwidth;
-  int bandwidthpow = (degree < 2 ? 4 : 8);
+  int bandwidthpow = 4 * (1 + static_cast<int>(degree) / 2);
   try {
     double ibias2 = ll_ibias2(degree);
     double ivar = ll_ivar(degree);
     bandwidth =
       std::pow(ivar / (bandwidthpow * n * ibias2), 1.0 / (bandwidthpow + 1));
   } catch (...) {
-    bandwidth = 4.0 * 1.06 * scale_ * std::pow(n, -1.0 / (bandwidthpow + 1));
+    bandwidth = reference_bandwidth(degree);
   }
   if (std::isnan(bandwidth)) {
-    bandwidth = 4.0 * 1.06 * scale_ * std::pow(n, -1.0 / (bandwidthpow + 1));
+    bandwidth = reference_bandwidth(degree);
+  } else {
+    bandwidth *= kernel_factor();
   }
 
+  state_.bandwidth = bandwidth;
   return bandwidth;
 }
 
+//! Selects the bandwidth by binned least-squares cross-validation.
+//!
+//! The criterion is computed for the local constant estimator from the bin
+//! counts via FFT, so each evaluation costs O(m log m) with m the number of
+//! bins. The minimizer is searched below the oversmoothed bandwidth
+//! (Wand and Jones' book, 3.2.1 and 3.3), or around the previous solution when
+//! warm-started. For `degree > 0`, it is rescaled by the ratio of the plug-in
+//! bandwidths for `degree` and the local constant estimator.
+//! @param degree degree of the local polynomial.
+inline double
+PluginBandwidthSelector::select_bandwidth_lscv(size_t degree)
+{
+  double n = effective_n();
+  double delta = kde_.get_bin_width();
+  double upper = 1.144 * scale_ * std::pow(n, -0.2);
+  double lower = 0.02 * upper;
+  size_t num_steps = 30;
+  if (!std::isnan(warm_start_.local_constant_bandwidth)) {
+    upper = 2.0 * warm_start_.local_constant_bandwidth;
+    lower = 0.5 * warm_start_.local_constant_bandwidth;
+    num_steps = 10;
+  }
+  lower = std::max(lower, 2 * delta);
+  if (!(lower < upper))
+    return finalize_local_constant(NAN, degree);
+
+  // coarse search on a log-scale grid
+  Eigen::VectorXd log_bw =
+    Eigen::VectorXd::LinSpaced(num_steps, std::log(lower), std::log(upper));
+  Eigen::VectorXd crit(num_steps);
+  for (size_t k = 0; k < num_steps; ++k)
+    crit(k) = lscv(std::exp(log_bw(k)));
+  if (crit.array().isNaN().any())
+    return finalize_local_constant(NAN, degree);
+  Eigen::Index k_min;
+  crit.minCoeff(&k_min);
+
+  // refine by golden section search between the neighbors of the minimum
+  double a = log_bw(std::max(k_min - 1, Eigen::Index(0)));
+  double b = log_bw(std::min(k_min + 1, Eigen::Index(num_steps - 1)));
+  const double ratio = (std::sqrt(5.0) - 1) / 2;
+  double c = b - ratio * (b - a), d = a + ratio * (b - a);
+  double fc = lscv(std::exp(c)), fd = lscv(std::exp(d));
+  for (int iter = 0; iter < 20; ++iter) {
+    if (fc < fd) {
+      b = d;
+      d = c;
+      fd = fc;
+      c = b - ratio * (b - a);
+      fc = lscv(std::exp(c));
+    } else {
+      a = c;
+      c = d;
+      fc = fd;
+      d = a + ratio * (b - a);
+      fd = lscv(std::exp(d));
+    }
+  }
+
+  return finalize_local_constant(std::exp((a + b) / 2), degree);
+}
+
+//! Selects the bandwidth by the Sheather and Jones (1991) solve-the-equation
+//! rule (see Wand and Jones' book, 3.6.1).
+//!
+//! All kernel functionals are computed from the bin counts via FFT. The
+//! equation is solved by bisection on the log-scale, starting from a bracket
+//! around the previous solution when warm-started. For `degree > 0`, the
+//! solution is rescaled by the ratio of the plug-in bandwidths for `degree`
+//! and the local constant estimator.
+//! @param degree degree of the local polynomial.
+inline double
+PluginBandwidthSelector::select_bandwidth_sj(size_t degree)
+{
+  double n = effective_n();
+  double lambda = 1.349 * scale_;
+
+  // pilot estimates for the constant in the pilot bandwidth g(h)
+  double psi4 = bkfe(4, 0.920 * lambda * std::pow(n, -1.0 / 7));
+  double psi6 = bkfe(6, 0.912 * lambda * std::pow(n, -1.0 / 9));
+  double alpha = 1.357 * std::pow(psi4 / -psi6, 1.0 / 7);
+  if (std::isnan(alpha))
+    return finalize_local_constant(NAN, degree);
+
+  // solve h = (R(K) / (n * psi4(g(h))))^(1/5), with R(K) = 1 / (2 sqrt(pi))
+  auto equation = [&](double log_bw) {
+    double bw = std::exp(log_bw);
+    double psi = bkfe(4, alpha * std::pow(bw, 5.0 / 7));
+    return log_bw - std::log(0.5 / (std::sqrt(M_PI) * n * psi)) / 5;
+  };
+  double lower = NAN, upper = NAN, f_lower = NAN;
+  if (!std::isnan(warm_start_.local_constant_bandwidth)) {
+    lower = std::log(0.5 * warm_start_.local_constant_bandwidth);
+    upper = std::log(2.0 * warm_start_.local_constant_bandwidth);
+    f_lower = equation(lower);
+  }
+  if (std::isnan(lower) || !(f_lower * equation(upper) < 0)) {
+    lower = std::log(0.01 * scale_ * std::pow(n, -0.2));
+    upper = std::log(10 * scale_ * std::pow(n, -0.2));
+    f_lower = equation(lower);
+    if (!(f_lower * equation(upper) < 0))
+      return finalize_local_constant(NAN, degree);
+  }
+  for (int iter = 0; iter < 40; ++iter) {
+    double mid = (lower + upper) / 2;
+    double f_mid = equation(mid);
+    if (std::isnan(f_mid))
+      return finalize_local_constant(NAN, degree);
+    if ((f_mid < 0) == (f_lower < 0)) {
+      lower = mid;
+      f_lower = f_mid;
+    } else {
+      upper = mid;
+    }
+  }
+
+  return finalize_local_constant(std::exp((lower + upper) / 2), degree);
+}
+
+//! transfers a bandwidth selected for the local constant estimator to a
+//! local polynomial of degree `degree` (falls back to the reference rule if
+//! the selection failed).
+//! @param bandwidth bandwidth for the local constant estimator (`NaN` if
+//!   selection failed).
+//! @param degree degree of the local polynomial.
+inline double
+PluginBandwidthSelector::finalize_local_constant(double bandwidth,
+                                                 size_t degree)
+{
+  double bw = reference_bandwidth(degree);
+  if (!std::isnan(bandwidth))
+    bw = bandwidth * degree_factor(degree) * kernel_factor();
+  state_.local_constant_bandwidth = bandwidth;
+  state_.bandwidth = bw;
+  return bw;
+}
+
+//! binned kernel functional estimate (that's bkfe() in KernSmooth).
+//! @param drv order of the derivative in the kernel functional.
+//! @param bandwidth the bandwidth parameter.
+inline double
+PluginBandwidthSelector::bkfe(unsigned drv, double bandwidth)
+{
+  kde_.set_bandwidth(bandwidth);
+  return bin_counts_.cwiseProduct(kde_.kde_drv(drv)).sum() / bin_counts_.sum();
+}
+
+//! binned least-squares cross-validation criterion for the local constant
+//! estimator (up to an additive constant).
+//! @param bandwidth the bandwidth parameter.
+inline double
+PluginBandwidthSelector::lscv(double bandwidth)
+{
+  double n = bin_counts_.sum();
+  double n_diag = (weights_.size() > 0) ? weights_.squaredNorm() : nobs_;
+  double int_f2 = bkfe(0, std::sqrt(2.0) * bandwidth);
+  double loo = n * n * bkfe(0, bandwidth);
+  loo -= n_diag * stats::dnorm(Eigen::VectorXd::Zero(1))(0) / bandwidth;
+  return int_f2 - 2 * loo / (n * (n - 1));
+}
+
+//! ratio of the plug-in bandwidths for a local polynomial of degree `degree`
+//! and the local constant estimator; used to transfer bandwidths selected for
+//! the local constant estimator to higher degrees.
+//! @param degree degree of the local polynomial.
+inline double
+PluginBandwidthSelector::degree_factor(size_t degree)
+{
+  if (degree == 0)
+    return 1.0;
+  return select_bandwidth(degree) / select_bandwidth(0);
+}
+
+//! checks whether the binned data differs from the warm start by less than
+//! `tol`, i.e., the range differs by less than `tol` times its length and the
+//! L1 distance between the normalized bin counts is less than `tol`.
+//! @param tol the tolerance; nonpositive values always return `false`.
+inline bool
+PluginBandwidthSelector::is_close_to_warm_start(double tol) const
+{
+  if (!(tol > 0) || std::isnan(warm_start_.bandwidth) ||
+      (warm_start_.bin_counts.size() != bin_counts_.size()))
+    return false;
+
+  double range_diff = std::fabs(state_.lower - warm_start_.lower) +
+                      std::fabs(state_.upper - warm_start_.upper);
+  if (!(range_diff <= tol * (state_.upper - state_.lower)))
+    return false;
+
+  Eigen::VectorXd diff = bin_counts_ / bin_counts_.sum() -
+                         warm_start_.bin_counts / warm_start_.bin_counts.sum();
+  return diff.cwiseAbs().sum() <= tol;
+}
+
+//! effective sample size.
+inline double
+PluginBandwidthSelector::effective_n() const
+{
+  if (weights_.size() == 0)
+    return nobs_;
+  return std::pow(weights_.sum(), 2) / weights_.cwiseAbs2().sum();
+}
+
+//! normal reference rule used when the selection method fails.
+//! @param degree degree of the local polynomial.
+inline double
+PluginBandwidthSelector::reference_bandwidth(size_t degree) const
+{
+  int bandwidthpow = 4 * (1 + static_cast<int>(degree) / 2);
+  double n = effective_n();
+  return 4.0 * 1.06 * scale_ * std::pow(n, -1.0 / (bandwidthpow + 1)) *
+         kernel_factor();
+}
+
+//! ratio of the optimal bandwidths for the kernel of the estimator and the
+//! Gaussian kernel.
+inline double
+PluginBandwidthSelector::kernel_factor() const
+{
+  if (kernel_.get_type() == KernelType::gaussian)
+    return 1.0;
+  return kernel_.canonical_bandwidth() / Kernel().canonical_bandwidth();
+}
+
 } // end kde1d::bandwidth
 
 } // end kde1d
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//! @file instrument.hpp
+//! Opt-in instrumentation of the stages of `Kde1d::fit()` and the evaluation
+//! functions.
+//!
+//! Compile with `-DKDE1D_INSTRUMENT` to record, for each stage, the number of
+//! calls, the wall time, and the number and size of heap allocations. Without
+//! the flag, the `KDE1D_STAGE()` markers expand to nothing and profiles stay
+//! empty. Allocations are only counted if, in addition, exactly one
+//! translation unit of the program defines `KDE1D_INSTRUMENT_MALLOC` before
+//! including kde1d (glibc only; see below); otherwise they are reported as
+//! zero.
+//!
+//! Stages are timed inclusively: nested stages (e.g., `pdf` within `loglik`)
+//! are also counted in the enclosing stage.
+
+#ifdef KDE1D_INSTRUMENT
+#define KDE1D_STAGE_CONCAT_(a, b) a##b
+#define KDE1D_STAGE_CONCAT(a, b) KDE1D_STAGE_CONCAT_(a, b)
+#define KDE1D_STAGE(profile, name)                                             \
+  ::kde1d::instrument::ScopedStage KDE1D_STAGE_CONCAT(kde1d_stage_,           \
+                                                      __LINE__)(profile, name)
+#else
+#define KDE1D_STAGE(profile, name)                                             \
+  do {                                                                         \
+    static_cast<void>(name);                                                   \
+  } while (false)
+#endif
+
+namespace kde1d {
+
+namespace instrument {
+
+//! accumulated measurements of a stage.
+struct Stage
+{
+  std::string name;
+  size_t calls{ 0 };
+  double seconds{ 0.0 };
+  size_t allocations{ 0 };
+  size_t bytes{ 0 };
+};
+
+//! A collection of stages in the order of their first occurrence.
+class Profile
+{
+public:
+  void record(const char* name,
+              double seconds,
+              size_t allocations,
+              size_t bytes);
+  const std::vector<Stage>& get_stages() const { return stages_; }
+  Stage get_stage(const std::string& name) const;
+  void clear() { stages_.clear(); }
+  std::string str() const;
+
+private:
+  std::vector<Stage> stages_;
+};
+
+namespace detail {
+
+//! protects all profiles, since evaluation functions record into (mutable)
+//! profiles of const objects.
+inline std::mutex&
+mutex()
+{
+  static std::mutex m;
+  return m;
+}
+
+//! allocation counters of the current thread; constant-initialized so that
+//! the allocation hooks may use them.
+struct AllocationCounter
+{
+  size_t count;
+  size_t bytes;
+};
+
+inline AllocationCounter&
+allocation_counter()
+{
+  static thread_local AllocationCounter counter{ 0, 0 };
+  return counter;
+}
+
+inline void
+record_allocation(size_t bytes)
+{
+  AllocationCounter& counter = allocation_counter();
+  ++counter.count;
+  counter.bytes += bytes;
+}
+
+} // end kde1d::instrument::detail
+
+//! the profile accumulated over all objects since the start of the program
+//! (or the last call of `reset_global_profile()`).
+inline Profile&
+global_profile()
+{
+  static Profile profile;
+  return profile;
+}
+
+//! returns a copy of the global profile.
+inline Profile
+get_global_profile()
+{
+  std::lock_guard<std::mutex> lock(detail::mutex());
+  return global_profile();
+}
+
+//! resets the global profile.
+inline void
+reset_global_profile()
+{
+  std::lock_guard<std::mutex> lock(detail::mutex());
+  global_profile().clear();
+}
+
+//! adds a measurement to a stage (not synchronized).
+inline void
+Profile::record(const char* name,
+                double seconds,
+                size_t allocations,
+                size_t bytes)
+{
+  auto stage = stages_.begin();
+  while ((stage != stages_.end()) && (stage->name != name))
+    ++stage;
+  if (stage == stages_.end()) {
+    stages_.push_back(Stage());
+    stage = stages_.end() - 1;
+    stage->name = name;
+  }
+  ++stage->calls;
+  stage->seconds += seconds;
+  stage->allocations += allocations;
+  stage->bytes += bytes;
+}
+
+//! the measurements of a stage (all zero if the stage was not recorded).
+inline Stage
+Profile::get_stage(const std::string& name) const
+{
+  for (const auto& stage : stages_) {
+    if (stage.name == name)
+      return stage;
+  }
+  Stage empty;
+  empty.name = name;
+  return empty;
+}
+
+//! a table of all stages.
+inline std::string
+Profile::str() const
+{
+  std::stringstream ss;
+  ss << std::left << std::setw(20) << "stage" << std::right << std::setw(8)
+     << "calls" << std::setw(14) << "time [ms]" << std::setw(10) << "allocs"
+     << std::setw(14) << "bytes" << "\n";
+  for (const auto& s : stages_) {
+    ss << std::left << std::setw(20) << s.name << std::right << std::setw(8)
+       << s.calls << std::setw(14) << std::fixed << std::setprecision(3)
+       << s.seconds * 1e3 << std::setw(10) << s.allocations << std::setw(14)
+       << s.bytes << "\n";
+  }
+  return ss.str();
+}
+
+//! Records the wall time and allocations between its construction and
+//! destruction in a profile and the global profile.
+class ScopedStage
+{
+public:
+  ScopedStage(Profile& profile, const char* name)
+    : profile_(profile)
+    , name_(name)
+    , allocations_(detail::allocation_counter().count)
+    , bytes_(detail::allocation_counter().bytes)
+    , start_(std::chrono::steady_clock::now())
+  {}
+
+  ~ScopedStage()
+  {
+    double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start_)
+                       .count();
+    size_t allocations = detail::allocation_counter().count - allocations_;
+    size_t bytes = detail::allocation_counter().bytes - bytes_;
+    std::lock_guard<std::mutex> lock(detail::mutex());
+    profile_.record(name_, seconds, allocations, bytes);
+    global_profile().record(name_, seconds, allocations, bytes);
+  }
+
+  ScopedStage(const ScopedStage&) = delete;
+  ScopedStage& operator=(const ScopedStage&) = delete;
+
+private:
+  Profile& profile_;
+  const char* name_;
+  size_t allocations_;
+  size_t bytes_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+} // end kde1d::instrument
+
+} // end kde1d
+
+// Allocation hooks. Eigen allocates through malloc(), so the hooks replace
+// malloc(), calloc() and realloc() of the program and forward to glibc's
+// implementation; operator new is covered since it calls malloc().
+#if defined(KDE1D_INSTRUMENT) && defined(KDE1D_INSTRUMENT_MALLOC) &&           \
+  defined(__GLIBC__)
+extern "C"
+{
+  void* __libc_malloc(size_t size);
+  void* __libc_calloc(size_t n, size_t size);
+  void* __libc_realloc(void* ptr, size_t size);
+
+  void* malloc(size_t size) noexcept
+  {
+    kde1d::instrument::detail::record_allocation(size);
+    return __libc_malloc(size);
+  }
+
+  void* calloc(size_t n, size_t size) noexcept
+  {
+    kde1d::instrument::detail::record_allocation(n * size);
+    return __libc_calloc(n, size);
+  }
+
+  void* realloc(void* ptr, size_t size) noexcept
+  {
+    kde1d::instrument::detail::record_allocation(size);
+    return __libc_realloc(ptr, size);
+  }
+}
+#endif
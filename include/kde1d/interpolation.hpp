@@ -2,6 +2,9 @@
 
 #include "tools.hpp"
 #include <Eigen/Dense>
+#include <cmath>
+#include <limits>
+#include <vector>
 
 namespace kde1d {
 
@@ -10,7 +13,10 @@ namespace interp {
 //! A class for cubic spline interpolation in one dimension
 //!
 //! The class is used for implementing kernel estimators. It makes storing the
-//! observations obsolete and allows for fast numerical integration.
+//! observations obsolete and allows for fast numerical integration. The
+//! coefficients of the spline in each cell and the integrals up to each grid
+//! point are computed once on construction, so that evaluating the spline
+//! or its integral at a point only requires locating its cell.
 class InterpolationGrid
 {
 public:
@@ -24,9 +30,18 @@ public:
 
   Eigen::VectorXd interpolate(const Eigen::VectorXd& x) const;
 
+  Eigen::VectorXd interpolate_log(const Eigen::VectorXd& x) const;
+
+  double extrapolate_log(const double& x) const;
+
   Eigen::VectorXd integrate(const Eigen::VectorXd& u,
                             bool normalize = false) const;
 
+  void interpolate_and_integrate(const Eigen::VectorXd& x,
+                                 Eigen::Ref<Eigen::VectorXd> values,
+                                 Eigen::Ref<Eigen::VectorXd> integrals,
+                                 bool normalize = false) const;
+
   Eigen::VectorXd get_values() const { return values_; }
   Eigen::VectorXd get_grid_points() const { return grid_points_; }
   double get_grid_max() const { return grid_points_[grid_points_.size() - 1]; }
@@ -34,16 +49,29 @@ public:
 
 private:
   // Utility functions for spline Interpolation
-  double cubic_poly(const double& x, const Eigen::VectorXd& a) const;
-  double cubic_indef_integral(const double& x, const Eigen::VectorXd& a) const;
+  double cubic_poly(const double& x, const Eigen::Vector4d& a) const;
+  double cubic_indef_integral(const double& x, const Eigen::Vector4d& a) const;
   double cubic_integral(const double& lower,
                         const double& upper,
-                        const Eigen::VectorXd& a) const;
+                        const Eigen::Vector4d& a) const;
   size_t find_cell(const double& x0) const;
-  Eigen::VectorXd find_cell_coefs(const size_t& k) const;
+  Eigen::Vector4d find_cell_coefs(const size_t& k) const;
+  void compute_cells();
+  template<class Fn>
+  void for_each_in_cell(const Eigen::VectorXd& x, Fn fn) const;
+  double interpolate_in_cell(const double& x, size_t k) const;
+  double integrate_in_cell(const double& x, size_t k) const;
 
   Eigen::VectorXd grid_points_;
   Eigen::VectorXd values_;
+  Eigen::Matrix<double, 4, Eigen::Dynamic> coefs_;
+  Eigen::VectorXd cum_integrals_;
+  // outermost positive values and the slopes of the log-values there (see
+  // `extrapolate_log()`)
+  Eigen::Index first_positive_{ 0 };
+  Eigen::Index last_positive_{ -1 };
+  double lower_log_slope_{ NAN };
+  double upper_log_slope_{ NAN };
 };
 
 //! Constructor
@@ -61,6 +89,7 @@ inline InterpolationGrid::InterpolationGrid(const Eigen::VectorXd& grid_points,
 
   grid_points_ = grid_points;
   values_ = values;
+  this->compute_cells();
   this->normalize(norm_times);
 }
 
@@ -70,36 +99,186 @@ inline InterpolationGrid::InterpolationGrid(const Eigen::VectorXd& grid_points,
 inline void
 InterpolationGrid::normalize(int times)
 {
-  double x_max = grid_points_(grid_points_.size() - 1);
-  double int_max;
   for (int k = 0; k < times; ++k) {
-    int_max = this->integrate(Eigen::VectorXd::Constant(1, x_max))(0);
-    values_ /= int_max;
+    values_ /= cum_integrals_(cum_integrals_.size() - 1);
+    this->compute_cells();
+  }
+}
+
+//! computes the coefficients of the spline in each cell, the integrals
+//! from the first grid point to each grid point, and the log-space tails
+//! beyond the outermost positive values.
+inline void
+InterpolationGrid::compute_cells()
+{
+  Eigen::Index m = grid_points_.size();
+  coefs_.resize(4, m - 1);
+  cum_integrals_ = Eigen::VectorXd::Zero(m);
+  for (Eigen::Index k = 0; k < m - 1; ++k) {
+    auto cell = static_cast<size_t>(k);
+    coefs_.col(k) = find_cell_coefs(cell);
+    double width = grid_points_(k + 1) - grid_points_(k);
+    cum_integrals_(k + 1) =
+      cum_integrals_(k) + cubic_integral(0.0, 1.0, coefs_.col(k)) * width;
+  }
+
+  first_positive_ = 0;
+  while ((first_positive_ < m) && !(values_(first_positive_) > 0))
+    ++first_positive_;
+  last_positive_ = m - 1;
+  while ((last_positive_ >= 0) && !(values_(last_positive_) > 0))
+    --last_positive_;
+  auto log_slope = [this](Eigen::Index k) {
+    return (std::log(values_(k + 1)) - std::log(values_(k))) /
+           (grid_points_(k + 1) - grid_points_(k));
+  };
+  lower_log_slope_ = NAN;
+  upper_log_slope_ = NAN;
+  if (first_positive_ < last_positive_) {
+    lower_log_slope_ = log_slope(first_positive_);
+    upper_log_slope_ = log_slope(last_positive_ - 1);
   }
 }
 
+//! calls `fn(i, k)` for each non-missing evaluation point `x(i)`, where `k`
+//! is the cell containing it (the first or last cell for points outside the
+//! grid).
+//!
+//! If the (non-missing) points are sorted, the cells are located by walking
+//! up the grid. Otherwise, each point is assigned to its cell by binary
+//! search; since all quantities of a cell are precomputed, the points do not
+//! need to be sorted or grouped by cell.
+//! @param x vector of evaluation points.
+//! @param fn a function taking the index of the point and the index of the
+//!   cell.
+template<class Fn>
+inline void
+InterpolationGrid::for_each_in_cell(const Eigen::VectorXd& x, Fn fn) const
+{
+  if (!tools::is_sorted(x)) {
+    for (Eigen::Index i = 0; i < x.size(); ++i) {
+      if (!std::isnan(x(i)))
+        fn(i, find_cell(x(i)));
+    }
+    return;
+  }
+
+  size_t k = 0, m = static_cast<size_t>(grid_points_.size());
+  for (Eigen::Index i = 0; i < x.size(); ++i) {
+    if (std::isnan(x(i)))
+      continue;
+    while ((k < m - 2) && (x(i) >= grid_points_(k + 1)))
+      ++k;
+    fn(i, k);
+  }
+}
+
+//! Interpolated value at a point in (or beyond the end of) cell k.
+inline double
+InterpolationGrid::interpolate_in_cell(const double& x, size_t k) const
+{
+  double xev = (x - grid_points_(k)) / (grid_points_(k + 1) - grid_points_(k));
+
+  // use Gaussian tail for extrapolation
+  if (xev <= 0) {
+    return values_(k) * std::exp(-0.5 * xev * xev);
+  } else if (xev >= 1) {
+    return values_(k + 1) * std::exp(-0.5 * xev * xev);
+  }
+
+  return cubic_poly(xev, coefs_.col(k));
+}
+
+//! Integral from the first grid point to a point in (or beyond the end of)
+//! cell k; zero below and the total integral above the grid.
+inline double
+InterpolationGrid::integrate_in_cell(const double& x, size_t k) const
+{
+  auto cell = static_cast<Eigen::Index>(k);
+  double width = grid_points_(cell + 1) - grid_points_(cell);
+  double xev = (x - grid_points_(cell)) / width;
+  if (xev <= 0) {
+    return (x <= grid_points_(0)) ? 0.0 : cum_integrals_(cell);
+  } else if (xev >= 1) {
+    return cum_integrals_(cell + 1);
+  }
+  return cum_integrals_(cell) +
+         cubic_integral(0.0, xev, coefs_.col(cell)) * width;
+}
+
 //! Interpolation
 //! @param x vector of evaluation points.
 inline Eigen::VectorXd
 InterpolationGrid::interpolate(const Eigen::VectorXd& x) const
 {
-  Eigen::VectorXd tmp_coefs(4);
-  auto interpolate_one = [&](const double& xx) {
-    size_t k = find_cell(xx);
-    double xev =
-      (xx - grid_points_(k)) / (grid_points_(k + 1) - grid_points_(k));
-
-    // use Gaussian tail for extrapolation
-    if (xev <= 0) {
-      return values_(k) * std::exp(-0.5 * xev * xev);
-    } else if (xev >= 1) {
-      return values_(k + 1) * std::exp(-0.5 * xev * xev);
+  Eigen::VectorXd res = x;
+  for_each_in_cell(x, [&](Eigen::Index i, size_t k) {
+    res(i) = interpolate_in_cell(x(i), k);
+  });
+  return res;
+}
+
+//! Logarithm of the interpolated values
+//!
+//! Equivalent to `interpolate(x).array().log()` where the interpolated values
+//! are positive, but the tails are evaluated in log space (see
+//! `extrapolate_log()`). They therefore stay finite far beyond the point
+//! where `interpolate()` underflows to zero.
+//! @param x vector of evaluation points.
+inline Eigen::VectorXd
+InterpolationGrid::interpolate_log(const Eigen::VectorXd& x) const
+{
+  double lower = grid_points_(0);
+  double upper = grid_points_(grid_points_.size() - 1);
+  Eigen::VectorXd res = x;
+  for_each_in_cell(x, [&](Eigen::Index i, size_t k) {
+    if ((x(i) <= lower) || (x(i) >= upper)) {
+      res(i) = extrapolate_log(x(i));
+      return;
     }
+    double f = interpolate_in_cell(x(i), k);
+    res(i) = (f > 0) ? std::log(f) : extrapolate_log(x(i));
+  });
+  return res;
+}
 
-    return cubic_poly(xev, find_cell_coefs(k));
-  };
+//! Logarithm of the tails
+//!
+//! Outside the grid, the values are extrapolated by a Gaussian tail from the
+//! boundary values (as in `interpolate()`). Where the boundary values are
+//! zero (e.g., since the estimate underflows on the outer grid points), the
+//! logarithm is instead extrapolated linearly from the outermost positive
+//! value, with the slope of the log-values between it and its inner
+//! neighbor.
+//! @param x an evaluation point outside the grid or where `interpolate(x)` is
+//!   not positive.
+//! @return the logarithm of the tail at `x` (-inf between positive values or
+//!   if the tail doesn't decay).
+inline double
+InterpolationGrid::extrapolate_log(const double& x) const
+{
+  Eigen::Index m = grid_points_.size();
+  if ((x <= grid_points_(0)) && (values_(0) > 0)) {
+    double xev = (x - grid_points_(0)) / (grid_points_(1) - grid_points_(0));
+    return std::log(values_(0)) - 0.5 * xev * xev;
+  }
+  if ((x >= grid_points_(m - 1)) && (values_(m - 1) > 0)) {
+    double xev = (x - grid_points_(m - 2)) /
+                 (grid_points_(m - 1) - grid_points_(m - 2));
+    return std::log(values_(m - 1)) - 0.5 * xev * xev;
+  }
 
-  return tools::unaryExpr_or_nan(x, interpolate_one);
+  if ((first_positive_ < m) && (x < grid_points_(first_positive_)) &&
+      (lower_log_slope_ > 0)) {
+    return std::log(values_(first_positive_)) +
+           lower_log_slope_ * (x - grid_points_(first_positive_));
+  }
+  if ((last_positive_ >= 0) && (x > grid_points_(last_positive_)) &&
+      (upper_log_slope_ < 0)) {
+    return std::log(values_(last_positive_)) +
+           upper_log_slope_ * (x - grid_points_(last_positive_));
+  }
+  return -std::numeric_limits<double>::infinity();
 }
 
 //! Integration along the grid
@@ -109,64 +288,43 @@ InterpolationGrid::interpolate(const Eigen::VectorXd& x) const
 inline Eigen::VectorXd
 InterpolationGrid::integrate(const Eigen::VectorXd& x, bool normalize) const
 {
-  Eigen::VectorXd res(x.size());
-  auto ord = tools::get_order(x);
-
-  // temporaries for the loop
-  Eigen::VectorXd tmp_coefs(4);
-  double new_int, tmp_eps, cum_int = 0.0;
-  size_t k = 0, m = grid_points_.size();
-  tmp_coefs = find_cell_coefs(0);
-  tmp_eps = (grid_points_(1) - grid_points_(0));
-
-  for (long i = 0; i < x.size(); ++i) {
-    double upr = x(ord(i));
-
-    if (std::isnan(upr)) {
-      res(ord(i)) = upr;
-      continue;
-    }
-    if (upr <= grid_points_(0)) {
-      res(ord(i)) = 0.0;
-      continue;
-    }
-
-    // go up the grid and integrate
-    while (k < m - 1) {
-      // halt loop if integration limit is in kth cell
-      if (upr < grid_points_(k + 1))
-        break;
-      // integrate over full cell
-      tmp_coefs = find_cell_coefs(k);
-      tmp_eps = (grid_points_(k + 1) - grid_points_(k));
-      cum_int += cubic_integral(0.0, 1.0, tmp_coefs) * tmp_eps;
-      k++;
-    }
-
-    // integrate over partial cell
-    if (upr < grid_points_(m - 1)) { // only if still in interior
-      tmp_coefs = find_cell_coefs(k);
-      tmp_eps = (grid_points_(k + 1) - grid_points_(k));
-      upr = (upr - grid_points_(k)) / tmp_eps;
-      new_int = cubic_integral(0.0, upr, tmp_coefs) * tmp_eps;
-    } else {
-      new_int = 0.0;
-    }
-
-    res(ord(i)) = cum_int + new_int;
-  }
+  Eigen::VectorXd res = x;
+  for_each_in_cell(x, [&](Eigen::Index i, size_t k) {
+    res(i) = integrate_in_cell(x(i), k);
+  });
 
   if (!normalize)
     return res;
+  return res / cum_integrals_(cum_integrals_.size() - 1);
+}
 
-  // integrate until end
-  while (k < m - 1) {
-    tmp_coefs = find_cell_coefs(k);
-    tmp_eps = (grid_points_(k + 1) - grid_points_(k));
-    cum_int += cubic_integral(0.0, 1.0, tmp_coefs) * tmp_eps;
-    k++;
-  }
-  return res / cum_int;
+//! Interpolation and integration in a single pass
+//!
+//! Equivalent to `values = interpolate(x)` and
+//! `integrals = integrate(x, normalize)`, but the cell of each evaluation
+//! point is located once for both. The results are written to the output
+//! buffers without allocating them.
+//! @param x vector of evaluation points.
+//! @param values output buffer for the interpolated values (same size as x).
+//! @param integrals output buffer for the integrals (same size as x).
+//! @param normalize whether to normalize the integral to a maximum value of 1.
+inline void
+InterpolationGrid::interpolate_and_integrate(
+  const Eigen::VectorXd& x,
+  Eigen::Ref<Eigen::VectorXd> values,
+  Eigen::Ref<Eigen::VectorXd> integrals,
+  bool normalize) const
+{
+  if ((values.size() != x.size()) || (integrals.size() != x.size()))
+    throw std::invalid_argument("output buffers must have the size of x");
+
+  values = x;
+  integrals = x;
+  double total = normalize ? cum_integrals_(cum_integrals_.size() - 1) : 1.0;
+  for_each_in_cell(x, [&](Eigen::Index i, size_t k) {
+    values(i) = interpolate_in_cell(x(i), k);
+    integrals(i) = integrate_in_cell(x(i), k) / total;
+  });
 }
 
 // ---------------- Utility functions for spline interpolation ----------------
@@ -176,7 +334,7 @@ InterpolationGrid::integrate(const Eigen::VectorXd& x, bool normalize) const
 //! @param x evaluation point.
 //! @param a polynomial coefficients
 inline double
-InterpolationGrid::cubic_poly(const double& x, const Eigen::VectorXd& a) const
+InterpolationGrid::cubic_poly(const double& x, const Eigen::Vector4d& a) const
 {
   double x2 = x * x;
   double x3 = x2 * x;
@@ -189,7 +347,7 @@ InterpolationGrid::cubic_poly(const double& x, const Eigen::VectorXd& a) const
 //! @param a polynomial coefficients.
 inline double
 InterpolationGrid::cubic_indef_integral(const double& x,
-                                        const Eigen::VectorXd& a) const
+                                        const Eigen::Vector4d& a) const
 {
   double x2 = x * x;
   double x3 = x2 * x;
@@ -205,7 +363,7 @@ InterpolationGrid::cubic_indef_integral(const double& x,
 inline double
 InterpolationGrid::cubic_integral(const double& lower,
                                   const double& upper,
-                                  const Eigen::VectorXd& a) const
+                                  const Eigen::Vector4d& a) const
 {
   return cubic_indef_integral(upper, a) - cubic_indef_integral(lower, a);
 }
@@ -229,7 +387,7 @@ InterpolationGrid::find_cell(const double& x0) const
 //! Calculate coefficients for cubic intrpolation spline
 //!
 //! @param k the cell index.
-inline Eigen::VectorXd
+inline Eigen::Vector4d
 InterpolationGrid::find_cell_coefs(const size_t& k) const
 {
   // indices for cell and neighboring grid points
@@ -266,7 +424,7 @@ InterpolationGrid::find_cell_coefs(const size_t& k) const
   dx2 = std::min(dx2, 3 * values_(k2));
 
   // compute coefficents
-  Eigen::VectorXd a(4);
+  Eigen::Vector4d a;
   a(0) = values_(k);
   a(1) = dx1;
   a(2) = -3 * (values_(k) - values_(k2)) - 2 * dx1 - dx2;
@@ -275,6 +433,89 @@ InterpolationGrid::find_cell_coefs(const size_t& k) const
   return a;
 }
 
+//! selects a subset of grid points on which interpolation reproduces the
+//! values on the full grid up to a given accuracy.
+//!
+//! The subset equidistributes the monitor
+//! \f$ (|\Delta^2 v_k| + \epsilon)^{1/3} \f$ over the grid, where
+//! \f$ \Delta^2 v_k \f$ are the second differences of the values and
+//! \f$ \epsilon \f$ is 0.1% of their maximum. Points are thus concentrated
+//! where the values are strongly curved, while the floor keeps a minimal
+//! density of points in the tails. The three outermost points at each end
+//! are always kept: the end points of a fitted grid may have been moved to
+//! the boundaries of the support, and the interpolant in the outermost cells
+//! then matches the one of the full grid. Starting from 33 points, the size
+//! of the subset is doubled until the maximum absolute deviation from the
+//! interpolant of the full grid (checked at the grid points and the
+//! midpoints of the cells) is at most `tol` times its maximum absolute value.
+//! @param grid_points an ascending sequence of grid points.
+//! @param values a vector of values of same length as grid_points.
+//! @param tol relative tolerance for the interpolation error.
+//! @return the (ascending) indices of the selected points.
+inline std::vector<size_t>
+select_grid_points(const Eigen::VectorXd& grid_points,
+                   const Eigen::VectorXd& values,
+                   double tol)
+{
+  size_t m = static_cast<size_t>(grid_points.size());
+  std::vector<size_t> all(m);
+  for (size_t k = 0; k < m; ++k)
+    all[k] = k;
+  if (m < 7)
+    return all;
+
+  Eigen::ArrayXd d2 = Eigen::ArrayXd::Zero(m);
+  d2.segment(1, m - 2) = (values.head(m - 2) - 2 * values.segment(1, m - 2) +
+                          values.tail(m - 2))
+                           .array()
+                           .abs();
+  d2(0) = d2(1);
+  d2(m - 1) = d2(m - 2);
+  Eigen::ArrayXd rho = (d2 + 1e-3 * d2.maxCoeff() + 1e-300).pow(1.0 / 3);
+
+  // cumulative monitor (trapezoidal rule in the index of the full grid)
+  Eigen::ArrayXd cum(m);
+  cum(0) = 0.0;
+  for (size_t k = 1; k < m; ++k)
+    cum(k) = cum(k - 1) + 0.5 * (rho(k - 1) + rho(k));
+
+  // the subset must reproduce the interpolant of the full grid at the grid
+  // points and midpoints of the cells
+  Eigen::VectorXd check_points(2 * m - 1);
+  check_points.head(m) = grid_points;
+  check_points.tail(m - 1) =
+    0.5 * (grid_points.head(m - 1) + grid_points.tail(m - 1));
+  Eigen::VectorXd check_values =
+    InterpolationGrid(grid_points, values, 0).interpolate(check_points);
+  double max_err = tol * check_values.cwiseAbs().maxCoeff();
+  for (size_t target = 33; target < m; target = 2 * target - 1) {
+    std::vector<size_t> ind{ 0, 1, 2 };
+    size_t k = 0;
+    for (size_t i = 1; i < target - 1; ++i) {
+      double level =
+        cum(m - 1) * static_cast<double>(i) / static_cast<double>(target - 1);
+      while (cum(k + 1) < level)
+        ++k;
+      size_t next = (level - cum(k) < cum(k + 1) - level) ? k : k + 1;
+      if ((next > ind.back()) && (next < m - 3))
+        ind.push_back(next);
+    }
+    ind.insert(ind.end(), { m - 3, m - 2, m - 1 });
+
+    Eigen::VectorXd sub_points(ind.size()), sub_values(ind.size());
+    for (size_t i = 0; i < ind.size(); ++i) {
+      sub_points(i) = grid_points(ind[i]);
+      sub_values(i) = values(ind[i]);
+    }
+    InterpolationGrid sub_grid(sub_points, sub_values, 0);
+    Eigen::VectorXd err = sub_grid.interpolate(check_points) - check_values;
+    if (err.cwiseAbs().maxCoeff() <= max_err)
+      return ind;
+  }
+
+  return all;
+}
+
 } // end kde1d::interp
 
 } // end kde1d
\ No newline at end of file
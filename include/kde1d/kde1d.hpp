@@ -1,11 +1,19 @@
 #pragma once
 
 #include "dpik.hpp"
+#include "instrument.hpp"
 #include "interpolation.hpp"
+#include "kdedirect.hpp"
+#include "locpoly.hpp"
 #include "stats.hpp"
 #include "tools.hpp"
 #include <cmath>
+#include <exception>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
 
 namespace kde1d {
 
@@ -16,6 +24,31 @@ enum class VarType
   zero_inflated
 };
 
+//! bandwidth selection methods.
+enum class BandwidthMethod
+{
+  plugin,
+  lscv,
+  sj
+};
+
+//! transformations of the data for density estimates with bounded support.
+enum class BoundaryType
+{
+  none,
+  left,
+  right,
+  both
+};
+
+//! sequences of uniform numbers for simulation.
+enum class SequenceType
+{
+  pseudo_random,
+  sobol,
+  scrambled_sobol
+};
+
 //! Local-polynomial density estimation in 1-d.
 class Kde1d
 {
@@ -26,14 +59,18 @@ public:
         VarType type,
         double multiplier = 1.0,
         double bandwidth = NAN,
-        size_t degree = 2);
+        size_t degree = 2,
+        BandwidthMethod bandwidth_method = BandwidthMethod::plugin,
+        KernelType kernel = KernelType::gaussian);
 
   Kde1d(double xmin = NAN,
         double xmax = NAN,
         std::string type = "continuous",
         double multiplier = 1.0,
         double bandwidth = NAN,
-        size_t degree = 2);
+        size_t degree = 2,
+        BandwidthMethod bandwidth_method = BandwidthMethod::plugin,
+        KernelType kernel = KernelType::gaussian);
 
   Kde1d(const interp::InterpolationGrid& grid,
         double xmin,
@@ -47,19 +84,55 @@ public:
         std::string type = "continuous",
         double prob0_ = 0.0);
 
-  void fit(const Eigen::VectorXd& x,
+  void fit(const Eigen::Ref<const Eigen::VectorXd>& x,
            const Eigen::VectorXd& weights = Eigen::VectorXd());
+  void set_warm_start(const Kde1d& previous, double tol = 0.0);
+  void set_binned_stats(bool binned_stats);
+  void set_grid_size(size_t grid_size);
+  void set_adaptive_grid(double tol);
 
   // statistical functions
   Eigen::VectorXd pdf(const Eigen::VectorXd& x,
                       const bool& check_fitted = true) const;
+  Eigen::VectorXd logpdf(const Eigen::VectorXd& x,
+                         const bool& check_fitted = true) const;
   Eigen::VectorXd cdf(const Eigen::VectorXd& x,
                       const bool& check_fitted = true) const;
+  void pdf_cdf(const Eigen::VectorXd& x,
+               Eigen::Ref<Eigen::VectorXd> pdf,
+               Eigen::Ref<Eigen::VectorXd> cdf,
+               const bool& check_fitted = true) const;
+  void pdf_cdf(const Eigen::VectorXd& x,
+               Eigen::Ref<Eigen::VectorXd> pdf,
+               Eigen::Ref<Eigen::VectorXd> cdf,
+               Eigen::Ref<Eigen::VectorXd> logpdf,
+               const bool& check_fitted = true) const;
   Eigen::VectorXd quantile(const Eigen::VectorXd& x,
                            const bool& check_fitted = true) const;
   Eigen::VectorXd simulate(size_t n,
                            const std::vector<int>& seeds = {},
                            const bool& check_fitted = true) const;
+  Eigen::VectorXd simulate(size_t n,
+                           SequenceType sequence,
+                           uint64_t seed = 0,
+                           const bool& check_fitted = true) const;
+  void simulate_into(Eigen::Ref<Eigen::VectorXd> buffer,
+                     uint64_t seed,
+                     uint64_t offset = 0,
+                     size_t num_threads = 1,
+                     const bool& check_fitted = true) const;
+  void simulate_into(Eigen::Ref<Eigen::VectorXd> buffer,
+                     SequenceType sequence,
+                     uint64_t seed,
+                     uint64_t offset = 0,
+                     size_t num_threads = 1,
+                     const bool& check_fitted = true) const;
+  Eigen::VectorXd pdf_exact(
+    const Eigen::VectorXd& x,
+    const Eigen::VectorXd& data,
+    const Eigen::VectorXd& weights = Eigen::VectorXd()) const;
+  Eigen::VectorXd loo_pdf(const Eigen::VectorXd& x) const;
+  double loo_loglik(const Eigen::VectorXd& x) const;
 
   // getters
   Eigen::VectorXd get_values() const { return grid_.get_values(); }
@@ -72,8 +145,11 @@ public:
   double get_multiplier() const { return multiplier_; }
   double get_bandwidth() const { return bandwidth_; }
   size_t get_degree() const { return degree_; }
-  double get_edf() const { return edf_; }
-  double get_loglik() const { return loglik_; }
+  BandwidthMethod get_bandwidth_method() const { return bandwidth_method_; }
+  KernelType get_kernel() const { return kernel_.get_type(); }
+  double get_edf() const;
+  double get_loglik() const;
+  instrument::Profile get_profile() const;
   void set_xmin_xmax(double xmin = NAN, double xmax = NAN);
 
   std::string str() const
@@ -96,22 +172,56 @@ private:
   double xmin_;
   double xmax_;
   VarType type_;
+  BoundaryType boundary_type_{ BoundaryType::none };
   double multiplier_;
   double bandwidth_;
   size_t degree_;
+  // degree of the fitted local polynomial; 0 if the fit had to fall back to
+  // the local constant estimate (see `fit_lp()`)
+  size_t lp_degree_{ 0 };
+  BandwidthMethod bandwidth_method_{ BandwidthMethod::plugin };
+  Kernel kernel_;
+  bandwidth::WarmStart warm_start_;
+  double warm_start_tol_{ 0.0 };
+  bandwidth::WarmStart selection_state_;
   double prob0_{ 0.0 };
-  double loglik_{ NAN };
-  double edf_{ NAN };
-  static constexpr double K0_ = 0.3989425;
+  bool fitted_{ false };
+  bool binned_stats_{ false };
+  double grid_normalization_{ 1.0 };
+  size_t nobs_{ 0 };
+  size_t grid_size_{ 401 };
+  double grid_tol_{ 0.0 };
+  // direct evaluation costs about 3-5 ns per observation and grid point in
+  // the kernel's support, the FFT path about 50 us per derivative on the
+  // default grid; fit_lp() evaluates directly up to this number of
+  // observations times grid points (about 100 observations)
+  static constexpr double max_direct_work_{ 4e4 };
+  // log-likelihood and effective degrees of freedom of the last fit; shared
+  // by copies of the model and computed at most once (see `fit_stats()`)
+  struct FitStats
+  {
+    std::once_flag computed;
+    Eigen::VectorXd observations;
+    double loglik{ NAN };
+    double edf{ NAN };
+  };
+  std::shared_ptr<FitStats> fit_stats_{ std::make_shared<FitStats>() };
+  interp::InterpolationGrid infl_grid_;
+  mutable instrument::Profile profile_;
 
   // private methods
   void check_fitted() const;
   void check_notfitted() const;
+  const FitStats& fit_stats() const;
   void check_xmin_xmax(const double& xmin, const double& xmax) const;
-  void check_inputs(const Eigen::VectorXd& x,
+  void check_inputs(const Eigen::Ref<const Eigen::VectorXd>& x,
                     const Eigen::VectorXd& weights = Eigen::VectorXd()) const;
-  void check_boundaries(const Eigen::VectorXd& x) const;
+  void check_boundaries(const Eigen::Ref<const Eigen::VectorXd>& x) const;
+  double prepare_data(Eigen::VectorXd& x,
+                      Eigen::VectorXd& weights,
+                      bool jitter = true) const;
   Eigen::VectorXd pdf_continuous(const Eigen::VectorXd& x) const;
+  Eigen::VectorXd logpdf_continuous(const Eigen::VectorXd& x) const;
   Eigen::VectorXd cdf_continuous(const Eigen::VectorXd& x) const;
   Eigen::VectorXd quantile_continuous(const Eigen::VectorXd& x) const;
   Eigen::VectorXd pdf_discrete(const Eigen::VectorXd& x) const;
@@ -119,30 +229,58 @@ private:
   Eigen::VectorXd quantile_discrete(const Eigen::VectorXd& x) const;
   Eigen::VectorXd pdf_zi(const Eigen::VectorXd& x) const;
   Eigen::VectorXd cdf_zi(const Eigen::VectorXd& x) const;
+  void pdf_cdf_discrete(const Eigen::VectorXd& x,
+                        Eigen::Ref<Eigen::VectorXd> pdf,
+                        Eigen::Ref<Eigen::VectorXd> cdf) const;
   Eigen::VectorXd quantile_zi(const Eigen::VectorXd& x) const;
 
-  Eigen::VectorXd kern_gauss(const Eigen::VectorXd& x);
   Eigen::MatrixXd fit_lp(const Eigen::VectorXd& x,
                          const Eigen::VectorXd& grid,
                          const Eigen::VectorXd& weights);
-  double calculate_infl(const size_t& n,
-                        const double& f0,
-                        const double& f1,
-                        const double& f2,
-                        const double& bandwidth,
-                        const double& s,
-                        const double& weight);
+  Eigen::MatrixXd fit_lp(const stats::JitteredLevels& x,
+                         const Eigen::VectorXd& grid);
+  template<class KdeEstimator, class Data>
+  Eigen::MatrixXd fit_lp(const KdeEstimator& kde,
+                         const Data& x,
+                         const Eigen::VectorXd& grid,
+                         const Eigen::VectorXd& weights);
+  static Eigen::VectorXd unweighted_bin_counts(const Eigen::VectorXd& x,
+                                               double lower,
+                                               double upper,
+                                               size_t num_bins);
+  static Eigen::VectorXd unweighted_bin_counts(const stats::JitteredLevels& x,
+                                               double lower,
+                                               double upper,
+                                               size_t num_bins);
+  Eigen::MatrixXd lp_estimate(const Eigen::MatrixXd& f,
+                              double bandwidth,
+                              size_t degree) const;
+  void set_boundary_type();
   Eigen::VectorXd boundary_transform(const Eigen::VectorXd& x,
-                                     bool inverse = false);
+                                     bool inverse = false) const;
+  template<BoundaryType boundary>
+  Eigen::VectorXd boundary_transform(const Eigen::VectorXd& x,
+                                     bool inverse) const;
+  Eigen::VectorXd boundary_correct(const Eigen::VectorXd& x,
+                                   const Eigen::VectorXd& fhat) const;
+  template<BoundaryType boundary>
   Eigen::VectorXd boundary_correct(const Eigen::VectorXd& x,
-                                   const Eigen::VectorXd& fhat);
-  Eigen::VectorXd construct_grid_points(const Eigen::VectorXd& x);
+                                   const Eigen::VectorXd& fhat) const;
+  Eigen::VectorXd construct_grid_points(double lower, double upper);
   Eigen::VectorXd finalize_grid(Eigen::VectorXd& grid_points);
+  bool flips_grid() const;
   double select_bandwidth(const Eigen::VectorXd& x,
                           double bandwidth,
                           double multiplier,
                           size_t degree,
-                          const Eigen::VectorXd& weights) const;
+                          const Eigen::VectorXd& weights);
+  double select_bandwidth(const stats::JitteredLevels& x,
+                          double bandwidth,
+                          double multiplier,
+                          size_t degree);
+  double run_bandwidth_selector(bandwidth::PluginBandwidthSelector& selector,
+                                size_t degree);
+  double finalize_bandwidth(double bandwidth, double multiplier) const;
 
   std::string as_str(VarType type) const;
   VarType as_enum(std::string type) const;
@@ -160,29 +298,46 @@ private:
 //! @param multiplier bandwidth multiplier (default is 1.0).
 //! @param bandwidth positive bandwidth parameter (`NaN` means automatic
 //! selection).
-//! @param degree degree of the local polynomial.
+//! @param degree degree of the local polynomial; 0, 1, or 2 for
+//!   log-polynomial fits, 3 or 4 for polynomial fits (equivalent to
+//!   higher-order kernels). Other kernels than the Gaussian require degree 0.
+//! @param bandwidth_method method for automatic bandwidth selection:
+//!   `BandwidthMethod::plugin` for the plug-in rule (default),
+//!   `BandwidthMethod::lscv` for binned least-squares cross-validation, or
+//!   `BandwidthMethod::sj` for the Sheather-Jones solve-the-equation rule.
+//! @param kernel the kernel function: `KernelType::gaussian` (default),
+//!   `KernelType::epanechnikov`, or `KernelType::biweight`.
 inline Kde1d::Kde1d(double xmin,
                     double xmax,
                     VarType type,
                     double multiplier,
                     double bandwidth,
-                    size_t degree)
+                    size_t degree,
+                    BandwidthMethod bandwidth_method,
+                    KernelType kernel)
   : xmin_(xmin)
   , xmax_(xmax)
   , type_(type)
   , multiplier_(multiplier)
   , bandwidth_(bandwidth)
   , degree_(degree)
+  , bandwidth_method_(bandwidth_method)
+  , kernel_(kernel)
 {
   this->check_xmin_xmax(xmin, xmax);
+  this->set_boundary_type();
   if (multiplier <= 0.0) {
     throw std::invalid_argument("multiplier must be positive");
   }
   if (!std::isnan(bandwidth_) && (bandwidth_ <= 0.0)) {
     throw std::invalid_argument("bandwidth must be positive");
   }
-  if (degree_ > 2) {
-    throw std::invalid_argument("degree must be 0, 1 or 2");
+  if (degree_ > 4) {
+    throw std::invalid_argument("degree must be 0, 1, 2, 3 or 4");
+  }
+  if ((degree_ > 0) && (kernel != KernelType::gaussian)) {
+    throw std::invalid_argument(
+      "degree must be 0 for kernels other than the Gaussian");
   }
 }
 
@@ -209,6 +364,7 @@ inline Kde1d::Kde1d(const interp::InterpolationGrid& grid,
   , prob0_(prob0)
 {
   this->check_xmin_xmax(xmin, xmax);
+  this->set_boundary_type();
   if ((prob0 < 0) || (prob0 > 1)) {
     throw std::invalid_argument("prob0 must lie in the interval [0, 1].");
   }
@@ -226,14 +382,31 @@ inline Kde1d::Kde1d(const interp::InterpolationGrid& grid,
 //! @param multiplier bandwidth multiplier (default is 1.0).
 //! @param bandwidth positive bandwidth parameter (`NaN` means automatic
 //! selection).
-//! @param degree degree of the local polynomial.
+//! @param degree degree of the local polynomial; 0, 1, or 2 for
+//!   log-polynomial fits, 3 or 4 for polynomial fits (equivalent to
+//!   higher-order kernels). Other kernels than the Gaussian require degree 0.
+//! @param bandwidth_method method for automatic bandwidth selection:
+//!   `BandwidthMethod::plugin` for the plug-in rule (default),
+//!   `BandwidthMethod::lscv` for binned least-squares cross-validation, or
+//!   `BandwidthMethod::sj` for the Sheather-Jones solve-the-equation rule.
+//! @param kernel the kernel function: `KernelType::gaussian` (default),
+//!   `KernelType::epanechnikov`, or `KernelType::biweight`.
 inline Kde1d::Kde1d(double xmin,
                     double xmax,
                     std::string type,
                     double multiplier,
                     double bandwidth,
-                    size_t degree)
-  : Kde1d(xmin, xmax, this->as_enum(type), multiplier, bandwidth, degree)
+                    size_t degree,
+                    BandwidthMethod bandwidth_method,
+                    KernelType kernel)
+  : Kde1d(xmin,
+          xmax,
+          this->as_enum(type),
+          multiplier,
+          bandwidth,
+          degree,
+          bandwidth_method,
+          kernel)
 {
 }
 
@@ -257,52 +430,76 @@ inline Kde1d::Kde1d(const interp::InterpolationGrid& grid,
 {
 }
 
-//! @param x vector of observations
+//! @param x vector of observations; any contiguous vector (e.g., an
+//!   `Eigen::Map` of memory-mapped data) is accepted as is. The fit copies
+//!   the observations to remove missing values and to transform them, and
+//!   keeps another copy for the log-likelihood unless binned statistics are
+//!   used (see `set_binned_stats()`); it holds at most three copies at a
+//!   time (two with binned statistics).
 //! @param weights vector of weights for each observation (optional).
 inline void
-Kde1d::fit(const Eigen::VectorXd& x, const Eigen::VectorXd& weights)
+Kde1d::fit(const Eigen::Ref<const Eigen::VectorXd>& x,
+           const Eigen::VectorXd& weights)
 {
+  profile_.clear();
+  KDE1D_STAGE(profile_, "fit");
   check_inputs(x, weights);
   check_boundaries(x);
 
-  // preprocessing for nans and jittering
+  // preprocessing for nans and jittering; unweighted discrete data is
+  // jittered implicitly (see stats::JitteredLevels)
+  bool jitter_levels = (type_ == VarType::discrete) && (weights.size() == 0);
   Eigen::VectorXd xx = x;
   Eigen::VectorXd w = weights;
-  tools::remove_nans(xx, w);
-
-  if (w.size() > 0)
-    w /= w.mean();
-
+  prob0_ = prepare_data(xx, w, !jitter_levels);
+  nobs_ = static_cast<size_t>((x.array() == x.array()).count());
   if (type_ == VarType::zero_inflated) {
-    if (w.size() == 0)
-      w = Eigen::VectorXd::Ones(xx.size());
-    w = (xx.array() == 0.0).select(Eigen::VectorXd::Zero(xx.size()), w);
-    prob0_ = 1 - w.mean();
-    xx =
-      (w.array() == 0.0).select(Eigen::VectorXd::Constant(xx.size(), NAN), xx);
-    tools::remove_nans(xx, w);
     if (xx.size() == 0) {
       bandwidth_ = NAN;
-      loglik_ = 0.0;
-      edf_ = 1.0;
+      fit_stats_ = std::make_shared<FitStats>();
+      fit_stats_->loglik = 0.0;
+      fit_stats_->edf = 1.0;
       Eigen::VectorXd grid_points(5);
       grid_points << -2, -1, 0, 1, 2;
       auto values = Eigen::VectorXd::Constant(5, 0.0);
       grid_ = interp::InterpolationGrid(grid_points, values, 0);
+      infl_grid_ = interp::InterpolationGrid(grid_points, values, 0);
+      fitted_ = true;
       return;
     }
-  } else if (type_ == VarType::discrete) {
-    xx = stats::equi_jitter(xx);
   }
 
-  xx = boundary_transform(xx);
-
-  // bandwidth selection
-  bandwidth_ = select_bandwidth(xx, bandwidth_, multiplier_, degree_, w);
-
-  // fit model and evaluate in transformed domain
-  Eigen::VectorXd grid_points = construct_grid_points(xx);
-  Eigen::MatrixXd fitted = fit_lp(xx, boundary_transform(grid_points), w);
+  // the observations are only kept if the statistics are computed from them
+  Eigen::VectorXd observations;
+  if (!binned_stats_ || (type_ == VarType::discrete))
+    observations = xx;
+
+  // bandwidth selection and fit in the transformed domain (discrete data
+  // is never transformed)
+  Eigen::VectorXd grid_points;
+  Eigen::MatrixXd fitted;
+  if (jitter_levels) {
+    auto levels = [&] {
+      KDE1D_STAGE(profile_, "jitter");
+      return stats::JitteredLevels(xx);
+    }();
+    if (levels.is_ordered()) {
+      bandwidth_ = select_bandwidth(levels, bandwidth_, multiplier_, degree_);
+      grid_points = construct_grid_points(levels.min(), levels.max());
+      fitted = fit_lp(levels, grid_points);
+    } else {
+      // the jittered levels of non-integer data may overlap
+      KDE1D_STAGE(profile_, "jitter");
+      xx = stats::equi_jitter(xx);
+      jitter_levels = false;
+    }
+  }
+  if (!jitter_levels) {
+    xx = boundary_transform(xx);
+    bandwidth_ = select_bandwidth(xx, bandwidth_, multiplier_, degree_, w);
+    grid_points = construct_grid_points(xx.minCoeff(), xx.maxCoeff());
+    fitted = fit_lp(xx, boundary_transform(grid_points), w);
+  }
 
   // correct estimated density for transformation
   Eigen::VectorXd values = boundary_correct(grid_points, fitted.col(0));
@@ -310,27 +507,185 @@ Kde1d::fit(const Eigen::VectorXd& x, const Eigen::VectorXd& weights)
   // move boundary points to xmin/xmax
   grid_points = finalize_grid(grid_points);
 
-  // construct interpolation grid
-  // (3 iterations for normalization to a proper density)
-  grid_ = interp::InterpolationGrid(grid_points, values, 3);
-
-  // calculate log-likelihood of final estimate
-  xx = boundary_transform(xx, true);
-  if (type_ == VarType::discrete) {
-    xx = xx.array().round();
+  // all fitted values are ordered as the transformed grid
+  Eigen::VectorXd infl = fitted.col(1).cwiseMin(3.0).cwiseMax(0);
+  Eigen::VectorXd counts = fitted.col(2);
+  if (flips_grid()) {
+    values.reverseInPlace();
+    infl.reverseInPlace();
+    counts.reverseInPlace();
   }
-  loglik_ = (this->pdf(xx, false).array().log()).sum();
 
-  // calculate effective degrees of freedom
-  interp::InterpolationGrid infl_grid(
-    grid_points, fitted.col(1).cwiseMin(3.0).cwiseMax(0), 0);
-  Eigen::VectorXd influences = infl_grid.interpolate(xx).array() * (1 - prob0_);
-  edf_ = influences.sum() + (prob0_ > 0);
+  // construct interpolation grids for the density and influence function
+  // (3 iterations for normalization to a proper density); an adaptive grid
+  // keeps only a subset of the points
+  Eigen::VectorXd knots = grid_points, knot_values = values, knot_infl = infl;
+  if (grid_tol_ > 0) {
+    KDE1D_STAGE(profile_, "adaptive_grid");
+    auto ind = interp::select_grid_points(grid_points, values, grid_tol_);
+    knots.resize(ind.size());
+    knot_values.resize(ind.size());
+    knot_infl.resize(ind.size());
+    for (size_t i = 0; i < ind.size(); ++i) {
+      knots(i) = grid_points(ind[i]);
+      knot_values(i) = values(ind[i]);
+      knot_infl(i) = infl(ind[i]);
+    }
+  }
+  {
+    KDE1D_STAGE(profile_, "normalization");
+    grid_ = interp::InterpolationGrid(knots, knot_values, 3);
+    grid_normalization_ = grid_.get_values().sum() / knot_values.sum();
+    infl_grid_ = interp::InterpolationGrid(knots, knot_infl, 0);
+  }
+  fit_stats_ = std::make_shared<FitStats>();
+  fitted_ = true;
+
+  if (binned_stats_ && (type_ != VarType::discrete)) {
+    // log-likelihood and effective degrees of freedom from the bin counts
+    KDE1D_STAGE(profile_, "loglik_edf");
+    Eigen::VectorXd log_f = logpdf_continuous(grid_points);
+    log_f = log_f.array() + std::log(1 - prob0_);
+    fit_stats_->loglik =
+      (counts.array() > 0).select(counts.array() * log_f.array(), 0.0).sum();
+    fit_stats_->edf =
+      counts.cwiseProduct(infl).sum() * (1 - prob0_) + (prob0_ > 0);
+  } else {
+    // keep observations for computing log-likelihood and effective degrees of
+    // freedom on demand
+    if (type_ == VarType::discrete) {
+      observations = observations.array().round();
+    }
+    fit_stats_->observations = std::move(observations);
+  }
 
   // store bandwidth in standardized format
   bandwidth_ = bandwidth_ / multiplier_;
 }
 
+//! computes log-likelihood and effective degrees of freedom from the binned
+//! data in subsequent fits.
+//!
+//! Each observation is then represented by its linear binning weights on
+//! the interpolation grid. Since linear binning reproduces linear functions,
+//! the error of the binned log-likelihood is at most
+//! \f$ n \delta^2 / 8 \max_z |(\log f)''(z)| \f$, where
+//! \f$ \delta \f$ is the grid spacing and \f$ f \f$ the estimated density,
+//! both in the (boundary-)transformed domain; the same bound holds for the
+//! effective degrees of freedom with the influence function in place of
+//! \f$ \log f \f$. The binned values are computed during the fit in
+//! O(grid size), so the observations need not be stored. Discrete
+//! variables always use the exact values.
+//! @param binned_stats whether to use the binned approximation.
+inline void
+Kde1d::set_binned_stats(bool binned_stats)
+{
+  binned_stats_ = binned_stats;
+}
+
+//! sets the number of grid points on which subsequent fits evaluate the
+//! estimate (401 by default).
+//!
+//! The points are equally spaced in the (boundary-)transformed domain. Finer
+//! grids resolve sharp modes and long tails better, at the cost of a
+//! proportionally larger model and fit.
+//! @param grid_size number of grid points; must be at least 5.
+inline void
+Kde1d::set_grid_size(size_t grid_size)
+{
+  if (grid_size < 5)
+    throw std::invalid_argument("grid_size must be at least 5.");
+  grid_size_ = grid_size;
+}
+
+//! stores subsequent fits on an adaptive (non-uniform) grid.
+//!
+//! The estimate is evaluated on the full grid (see `set_grid_size()`), but
+//! only a subset of the points is kept for interpolation: points are
+//! concentrated where the estimate is strongly curved, and the subset is
+//! refined until interpolating it reproduces the estimate on the full grid
+//! up to `tol` times its maximum (see `interp::select_grid_points()`).
+//! Smooth and heavy-tailed densities typically need far fewer points, which
+//! makes models smaller and evaluation slightly faster; combined with a
+//! larger `grid_size`, sharp modes are resolved without storing a fine grid
+//! in the tails.
+//! @param tol relative tolerance for the interpolation error; values
+//!   `<= 0` (the default) keep the full grid.
+inline void
+Kde1d::set_adaptive_grid(double tol)
+{
+  if (std::isnan(tol))
+    throw std::invalid_argument("tol must not be NaN.");
+  grid_tol_ = tol;
+}
+
+//! log-likelihood of the fitted model.
+//!
+//! The log-likelihood is computed together with the effective degrees of
+//! freedom on first access (see `fit_stats()`); the call is thread-safe.
+inline double
+Kde1d::get_loglik() const
+{
+  return fit_stats().loglik;
+}
+
+//! effective degrees of freedom of the fitted model.
+//!
+//! The effective degrees of freedom are computed together with the
+//! log-likelihood on first access (see `fit_stats()`); the call is
+//! thread-safe.
+inline double
+Kde1d::get_edf() const
+{
+  return fit_stats().edf;
+}
+
+//! the time and memory spent in the stages of the last fit and in subsequent
+//! calls of the evaluation functions.
+//!
+//! Stages are only recorded when compiled with `KDE1D_INSTRUMENT` (see
+//! instrument.hpp); otherwise the profile is empty.
+inline instrument::Profile
+Kde1d::get_profile() const
+{
+  std::lock_guard<std::mutex> lock(instrument::detail::mutex());
+  return profile_;
+}
+
+//! warm-starts the bandwidth selection of the next fit from a model fitted
+//! to similar data.
+//!
+//! The scale estimate and pilot bandwidths of the previous selection are
+//! reused, and LSCV and SJ search around the previous solution.
+//! @param previous a model fitted with automatic bandwidth selection and the
+//!   same variable type, bounds, degree, kernel, and bandwidth method.
+//! @param tol if positive, the previous bandwidth is reused without
+//!   reselection when the binned data differ by less than `tol` (the ranges
+//!   differ by less than `tol` times the range and the L1 distance between
+//!   the normalized bin counts is less than `tol`).
+inline void
+Kde1d::set_warm_start(const Kde1d& previous, double tol)
+{
+  if (std::isnan(previous.selection_state_.bandwidth)) {
+    throw std::invalid_argument(
+      "previous model must be fitted with automatic bandwidth selection.");
+  }
+  auto same_bound = [](double a, double b) {
+    return (a == b) || (std::isnan(a) && std::isnan(b));
+  };
+  if ((previous.type_ != type_) || (previous.degree_ != degree_) ||
+      (previous.bandwidth_method_ != bandwidth_method_) ||
+      (previous.get_kernel() != get_kernel()) ||
+      !same_bound(previous.xmin_, xmin_) ||
+      !same_bound(previous.xmax_, xmax_)) {
+    throw std::invalid_argument("previous model must have the same type, "
+                                "bounds, degree, kernel, and bandwidth "
+                                "method.");
+  }
+  warm_start_ = previous.selection_state_;
+  warm_start_tol_ = tol;
+}
+
 //! computes the pdf of the kernel density estimate by interpolation.
 //! @param x vector of evaluation points.
 //! @param check_fitted an optional logical to bypass the check.
@@ -338,6 +693,7 @@ Kde1d::fit(const Eigen::VectorXd& x, const Eigen::VectorXd& weights)
 inline Eigen::VectorXd
 Kde1d::pdf(const Eigen::VectorXd& x, const bool& check_fitted) const
 {
+  KDE1D_STAGE(profile_, "pdf");
   if (check_fitted == true) {
     this->check_fitted();
   }
@@ -388,6 +744,43 @@ Kde1d::pdf_zi(const Eigen::VectorXd& x) const
     .select(prob0_ * ones.array(), (1 - prob0_) * pdf_continuous(x).array());
 }
 
+//! computes the logarithm of the pdf of the kernel density estimate.
+//!
+//! Equivalent to `pdf(x).array().log()` where the pdf is positive, but the
+//! tails are evaluated in log space, so that the result stays finite far out
+//! in the tails where `pdf()` underflows to zero. Where the fitted values on
+//! the outer grid points are zero, the tails continue from the outermost
+//! positive value (see `interp::InterpolationGrid::extrapolate_log()`).
+//! @param x vector of evaluation points.
+//! @param check_fitted an optional logical to bypass the check.
+//! @return a vector of log-pdf values (-inf where the pdf is zero).
+inline Eigen::VectorXd
+Kde1d::logpdf(const Eigen::VectorXd& x, const bool& check_fitted) const
+{
+  KDE1D_STAGE(profile_, "logpdf");
+  if (check_fitted == true) {
+    this->check_fitted();
+  }
+  check_inputs(x);
+
+  switch (type_) {
+    default:
+      return logpdf_continuous(x);
+    case VarType::discrete:
+      return pdf_discrete(x).array().log();
+    case VarType::zero_inflated:
+      return (x.array() == 0)
+        .select(std::log(prob0_),
+                std::log1p(-prob0_) + logpdf_continuous(x).array());
+  }
+}
+
+inline Eigen::VectorXd
+Kde1d::logpdf_continuous(const Eigen::VectorXd& x) const
+{
+  return grid_.interpolate_log(x);
+}
+
 //! computes the cdf of the kernel density estimate by numerical
 //! integration.
 //! @param x vector of evaluation points.
@@ -396,6 +789,7 @@ Kde1d::pdf_zi(const Eigen::VectorXd& x) const
 inline Eigen::VectorXd
 Kde1d::cdf(const Eigen::VectorXd& x, const bool& check_fitted) const
 {
+  KDE1D_STAGE(profile_, "cdf");
   if (check_fitted == true) {
     this->check_fitted();
   }
@@ -449,6 +843,114 @@ Kde1d::cdf_zi(const Eigen::VectorXd& x) const
   return prob0_ * zi + (1 - prob0_) * (prob0_ < 1 ? cdf_continuous(x) : zeros);
 }
 
+//! computes the pdf and cdf of the kernel density estimate in a single pass.
+//!
+//! Equivalent to `pdf = this->pdf(x)` and `cdf = this->cdf(x)`, but the
+//! grid cell of each evaluation point is located once for both, and the
+//! results are written to the output buffers without allocating them (they
+//! may also be blocks of a matrix, e.g., `m.col(0)`).
+//! @param x vector of evaluation points.
+//! @param pdf output buffer for the pdf values (same size as x).
+//! @param cdf output buffer for the cdf values (same size as x).
+//! @param check_fitted an optional logical to bypass the check.
+inline void
+Kde1d::pdf_cdf(const Eigen::VectorXd& x,
+               Eigen::Ref<Eigen::VectorXd> pdf,
+               Eigen::Ref<Eigen::VectorXd> cdf,
+               const bool& check_fitted) const
+{
+  KDE1D_STAGE(profile_, "pdf_cdf");
+  if (check_fitted == true) {
+    this->check_fitted();
+  }
+  check_inputs(x);
+  if ((pdf.size() != x.size()) || (cdf.size() != x.size()))
+    throw std::invalid_argument("output buffers must have the size of x");
+
+  if (type_ == VarType::discrete)
+    return pdf_cdf_discrete(x, pdf, cdf);
+
+  grid_.interpolate_and_integrate(x, pdf, cdf, /* normalize */ true);
+  pdf = pdf.unaryExpr(
+    [](double f) { return std::isnan(f) ? f : std::max(f, 0.0); });
+  if (type_ == VarType::zero_inflated) {
+    for (Eigen::Index i = 0; i < x.size(); ++i) {
+      pdf(i) = (x(i) == 0) ? prob0_ : (1 - prob0_) * pdf(i);
+      cdf(i) = prob0_ * (x(i) >= 0) + (1 - prob0_) * (prob0_ < 1 ? cdf(i) : 0);
+    }
+  }
+}
+
+//! computes the pdf, cdf, and log-pdf of the kernel density estimate in a
+//! single pass.
+//!
+//! See the overload without `logpdf`; the log-pdf equals `logpdf(x)`.
+//! @param x vector of evaluation points.
+//! @param pdf output buffer for the pdf values (same size as x).
+//! @param cdf output buffer for the cdf values (same size as x).
+//! @param logpdf output buffer for the logarithm of the pdf values (same size
+//!   as x).
+//! @param check_fitted an optional logical to bypass the check.
+inline void
+Kde1d::pdf_cdf(const Eigen::VectorXd& x,
+               Eigen::Ref<Eigen::VectorXd> pdf,
+               Eigen::Ref<Eigen::VectorXd> cdf,
+               Eigen::Ref<Eigen::VectorXd> logpdf,
+               const bool& check_fitted) const
+{
+  if (logpdf.size() != x.size())
+    throw std::invalid_argument("output buffers must have the size of x");
+  this->pdf_cdf(x, pdf, cdf, check_fitted);
+  logpdf = pdf.array().log().matrix();
+  if (type_ == VarType::discrete)
+    return;
+
+  // tails in log space (see logpdf())
+  bool zi = (type_ == VarType::zero_inflated);
+  double lower = grid_.get_grid_min(), upper = grid_.get_grid_max();
+  double log_scale = zi ? std::log1p(-prob0_) : 0.0;
+  for (Eigen::Index i = 0; i < x.size(); ++i) {
+    bool tail = (x(i) <= lower) || (x(i) >= upper) || (pdf(i) == 0);
+    if (tail && !(zi && (x(i) == 0)))
+      logpdf(i) = log_scale + grid_.extrapolate_log(x(i));
+  }
+}
+
+//! pdf and cdf of discrete models; both are read off the (cumulated)
+//! probabilities of the levels, which are computed once.
+inline void
+Kde1d::pdf_cdf_discrete(const Eigen::VectorXd& x,
+                        Eigen::Ref<Eigen::VectorXd> pdf,
+                        Eigen::Ref<Eigen::VectorXd> cdf) const
+{
+  auto lb = std::floor(grid_.get_grid_min());
+  auto ub = std::ceil(grid_.get_grid_max());
+  Eigen::VectorXd lvs =
+    Eigen::VectorXd::LinSpaced(static_cast<size_t>(ub - lb + 1), lb, ub);
+  Eigen::VectorXd f_lvs = pdf_discrete(lvs);
+  Eigen::VectorXd f_cum = f_lvs;
+  for (Eigen::Index i = 1; i < f_cum.size(); ++i)
+    f_cum(i) += f_cum(i - 1);
+
+  for (Eigen::Index i = 0; i < x.size(); ++i) {
+    double xx = x(i);
+    if (std::isnan(xx)) {
+      pdf(i) = xx;
+      cdf(i) = xx;
+    } else if (xx < lb) {
+      pdf(i) = 0.0;
+      cdf(i) = 0.0;
+    } else if (xx >= ub) {
+      pdf(i) = (xx == ub) ? f_lvs(f_lvs.size() - 1) : 0.0;
+      cdf(i) = 1.0;
+    } else {
+      auto k = static_cast<Eigen::Index>(xx - lb);
+      pdf(i) = (xx == std::round(xx)) ? f_lvs(k) : 0.0;
+      cdf(i) = f_cum(k);
+    }
+  }
+}
+
 //! computes the cdf of the kernel density estimate by numerical inversion.
 //! @param x vector of evaluation points.
 //! @param check_fitted an optional logical to bypass the check.
@@ -456,6 +958,7 @@ Kde1d::cdf_zi(const Eigen::VectorXd& x) const
 inline Eigen::VectorXd
 Kde1d::quantile(const Eigen::VectorXd& x, const bool& check_fitted) const
 {
+  KDE1D_STAGE(profile_, "quantile");
   if (check_fitted == true) {
     this->check_fitted();
   }
@@ -534,6 +1037,7 @@ Kde1d::simulate(size_t n,
                 const std::vector<int>& seeds,
                 const bool& check_fitted) const
 {
+  KDE1D_STAGE(profile_, "simulate");
   if (check_fitted == true) {
     this->check_fitted();
   }
@@ -541,19 +1045,271 @@ Kde1d::simulate(size_t n,
   return this->quantile(u);
 }
 
-//! Gaussian kernel (truncated at +/- 5).
-//! @param x vector of evaluation points.
+//! simulates data from the model using a quasi-random sequence.
+//!
+//! Uniform numbers from `sequence` are pushed through `quantile()`. With a
+//! (scrambled) Sobol sequence, Monte Carlo averages over the simulated data
+//! are much more precise than over random draws of the same size, in
+//! particular when `n` is a power of two.
+//! @param n the number of observations to simulate.
+//! @param sequence the type of sequence, see `SequenceType`;
+//!   `SequenceType::pseudo_random` gives the same draws as `simulate_into()`.
+//! @param seed the seed of the random draws or the scrambling (ignored for
+//!   `SequenceType::sobol`).
+//! @param check_fitted an optional logical to bypass the check.
+//! @return simulated observations from the kernel density.
 inline Eigen::VectorXd
-Kde1d::kern_gauss(const Eigen::VectorXd& x)
+Kde1d::simulate(size_t n,
+                SequenceType sequence,
+                uint64_t seed,
+                const bool& check_fitted) const
 {
-  auto f = [](double xx) {
-    // truncate at +/- 5
-    if (std::fabs(xx) > 5.0)
-      return 0.0;
-    // otherwise calculate normal pdf (orrect for truncation)
-    return stats::dnorm(Eigen::VectorXd::Constant(1, xx))(0) / 0.999999426;
+  Eigen::VectorXd x(n);
+  this->simulate_into(x, sequence, seed, 0, 1, check_fitted);
+  return x;
+}
+
+//! simulates data from the model into a pre-allocated buffer.
+//!
+//! Uniform draws come from a counter-based generator (see
+//! `stats::simulate_uniform_philox()`): the `i`-th element of the buffer is
+//! the `offset + i`-th draw of the stream defined by `seed`. Results are
+//! hence identical for any number of threads, and a long stream can be
+//! simulated chunk by chunk by advancing `offset`.
+//! @param buffer the output vector; its size is the number of draws.
+//! @param seed the seed of the stream.
+//! @param offset the index of the first draw in the stream.
+//! @param num_threads the number of threads.
+//! @param check_fitted an optional logical to bypass the check.
+inline void
+Kde1d::simulate_into(Eigen::Ref<Eigen::VectorXd> buffer,
+                     uint64_t seed,
+                     uint64_t offset,
+                     size_t num_threads,
+                     const bool& check_fitted) const
+{
+  this->simulate_into(buffer,
+                      SequenceType::pseudo_random,
+                      seed,
+                      offset,
+                      num_threads,
+                      check_fitted);
+}
+
+//! simulates data from the model into a pre-allocated buffer, using the
+//! `offset + i`-th element of `sequence` for the `i`-th element of the
+//! buffer (see `stats::simulate_uniform_philox()` and
+//! `stats::simulate_uniform_sobol()`).
+//! @param buffer the output vector; its size is the number of draws.
+//! @param sequence the type of sequence, see `SequenceType`.
+//! @param seed the seed of the random draws or the scrambling (ignored for
+//!   `SequenceType::sobol`).
+//! @param offset the index of the first element in the sequence.
+//! @param num_threads the number of threads.
+//! @param check_fitted an optional logical to bypass the check.
+inline void
+Kde1d::simulate_into(Eigen::Ref<Eigen::VectorXd> buffer,
+                     SequenceType sequence,
+                     uint64_t seed,
+                     uint64_t offset,
+                     size_t num_threads,
+                     const bool& check_fitted) const
+{
+  KDE1D_STAGE(profile_, "simulate");
+  if (check_fitted == true) {
+    this->check_fitted();
+  }
+  if (num_threads == 0)
+    throw std::invalid_argument("num_threads must be positive.");
+  const uint64_t max_sobol = uint64_t(1) << 32;
+  if ((sequence != SequenceType::pseudo_random) &&
+      ((offset > max_sobol) ||
+       (static_cast<uint64_t>(buffer.size()) > max_sobol - offset)))
+    throw std::invalid_argument("the Sobol sequence has at most 2^32 points.");
+
+  // each thread works on a contiguous range in blocks, so that the uniforms
+  // never have to be held in memory all at once
+  auto simulate_range = [&](Eigen::Index begin, Eigen::Index end) {
+    const Eigen::Index block_size = 4096;
+    Eigen::VectorXd u;
+    for (Eigen::Index b = begin; b < end; b += block_size) {
+      auto len = std::min(block_size, end - b);
+      u.resize(len);
+      auto first = offset + static_cast<uint64_t>(b);
+      if (sequence == SequenceType::pseudo_random) {
+        stats::simulate_uniform_philox(u, seed, first);
+      } else {
+        stats::simulate_uniform_sobol(
+          u, sequence == SequenceType::scrambled_sobol, seed, first);
+      }
+      buffer.segment(b, len) = this->quantile(u, false);
+    }
   };
-  return x.unaryExpr(f);
+
+  auto n = buffer.size();
+  auto threads = std::min(static_cast<Eigen::Index>(num_threads), n);
+  if (threads <= 1) {
+    simulate_range(0, n);
+    return;
+  }
+
+  std::vector<std::thread> pool;
+  std::vector<std::exception_ptr> errors(static_cast<size_t>(threads));
+  for (Eigen::Index t = 0; t < threads; ++t) {
+    pool.emplace_back([&, t] {
+      try {
+        simulate_range(n * t / threads, n * (t + 1) / threads);
+      } catch (...) {
+        errors[static_cast<size_t>(t)] = std::current_exception();
+      }
+    });
+  }
+  for (auto& thread : pool)
+    thread.join();
+  for (auto& error : errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+}
+
+//! computes the pdf of the kernel density estimate by exact evaluation of the
+//! local polynomial estimator.
+//!
+//! Unlike `pdf()`, which interpolates the estimate on a grid, the kernel
+//! sums are evaluated directly at `x` using the bandwidth, degree, and
+//! boundary transformation of the fitted model. This is useful for
+//! evaluation at the observations themselves (e.g., for outlier scores) and
+//! for checking the accuracy of the binned fit. The estimate is scaled by the
+//! same normalizing constant as the fitted grid, so it differs from `pdf()`
+//! only by the binning and interpolation errors.
+//! @param x vector of evaluation points.
+//! @param data the observations (usually the ones used for fitting).
+//! @param weights vector of weights for each observation (optional).
+//! @return a vector of pdf values.
+inline Eigen::VectorXd
+Kde1d::pdf_exact(const Eigen::VectorXd& x,
+                 const Eigen::VectorXd& data,
+                 const Eigen::VectorXd& weights) const
+{
+  this->check_fitted();
+  check_inputs(x);
+  check_inputs(data, weights);
+
+  Eigen::VectorXd xx = data;
+  Eigen::VectorXd w = weights;
+  prepare_data(xx, w);
+  if (xx.size() == 0)
+    return pdf(x);
+  if (std::isnan(bandwidth_)) {
+    throw std::runtime_error(
+      "pdf_exact() requires a model fitted with fit().");
+  }
+
+  // evaluate at the support points of the model
+  Eigen::VectorXd x_ev = x;
+  if (type_ == VarType::discrete) {
+    auto lb = std::floor(grid_.get_grid_min());
+    auto ub = std::ceil(grid_.get_grid_max());
+    auto nlevels = static_cast<Eigen::Index>(ub - lb + 1);
+    x_ev.conservativeResize(x.size() + nlevels);
+    x_ev.tail(nlevels) = Eigen::VectorXd::LinSpaced(nlevels, lb, ub);
+  }
+  Eigen::Array<bool, Eigen::Dynamic, 1> outside =
+    (x_ev.array() < xmin_) || (x_ev.array() > xmax_);
+
+  double h = bandwidth_ * multiplier_;
+  Eigen::MatrixXd f = direct::kde_drvs(boundary_transform(x_ev),
+                                       boundary_transform(xx),
+                                       h,
+                                       static_cast<unsigned>(degree_),
+                                       w,
+                                       kernel_);
+  Eigen::VectorXd fhat =
+    boundary_correct(x_ev, lp_estimate(f, h, lp_degree_).col(0));
+  fhat = outside.select(0.0, fhat.array().isNaN().select(0.0, fhat));
+  fhat = x_ev.array().isNaN().select(x_ev, fhat * grid_normalization_);
+
+  switch (type_) {
+    default:
+      return fhat;
+    case VarType::discrete: {
+      double norm = fhat.tail(fhat.size() - x.size()).sum();
+      auto selected = (x.array() == x.array().round());
+      return selected.select(fhat.head(x.size()) / norm, 0.0);
+    }
+    case VarType::zero_inflated:
+      return (x.array() == 0).select(prob0_, (1 - prob0_) * fhat.array());
+  }
+}
+
+//! computes leave-one-out density values at the observations.
+//!
+//! The influence function of the fit is the contribution of an observation
+//! to the estimate at its own location (relative to the estimate). Removing
+//! this contribution and renormalizing gives
+//! \f$ \hat f_{-i}(x_i) = \hat f(x_i) (1 - \mathrm{infl}(x_i)) / (1 - 1/n) \f$,
+//! which is exact for degree 0 and first-order accurate otherwise (up to
+//! binning and interpolation errors). The computations reuse the fitted grids
+//! and take O(n) time. For weighted fits, each observation is assumed to have
+//! the average weight of its grid cell.
+//!
+//! Observations that are isolated (in the boundary-transformed domain) carry
+//! most of the mass around them and have an influence close to (or above)
+//! one, where the approximation breaks down. For observations with influence
+//! above 0.5, the model is refitted (with the same bandwidth) to the
+//! remaining observations instead, which takes O(n) time per such
+//! observation. The refits ignore the weights of weighted fits.
+//! @param x vector of observations used for fitting the model.
+//! @return a vector of leave-one-out pdf values.
+inline Eigen::VectorXd
+Kde1d::loo_pdf(const Eigen::VectorXd& x) const
+{
+  this->check_fitted();
+  check_inputs(x);
+  if (nobs_ < 2) {
+    throw std::runtime_error(
+      "loo_pdf() requires a model fitted to at least two observations.");
+  }
+
+  Eigen::ArrayXd infl = infl_grid_.interpolate(x).cwiseMax(0.0);
+  Eigen::ArrayXd loo = pdf(x, false).array() * (1.0 - infl).cwiseMax(0.0);
+  double n = static_cast<double>(nobs_);
+  if (type_ != VarType::zero_inflated) {
+    loo /= 1.0 - 1.0 / n;
+  } else {
+    // the point mass changes as well when an observation is left out
+    double n0 = prob0_ * n;
+    double n_cont = n - n0;
+    double scale = 0.0;
+    if (n_cont > 1.0)
+      scale = (1.0 - n0 / (n - 1.0)) / ((1.0 - prob0_) * (1.0 - 1.0 / n_cont));
+    loo = (x.array() == 0.0).select((n0 - 1.0) / (n - 1.0), loo * scale);
+  }
+
+  // refits for influential observations (the bandwidth is kept fixed)
+  auto n_x = x.size();
+  for (Eigen::Index i = 0; i < n_x; ++i) {
+    if (!(infl(i) > 0.5) || ((type_ == VarType::zero_inflated) && (x(i) == 0)))
+      continue;
+    Eigen::VectorXd x_minus(n_x - 1);
+    x_minus << x.head(i), x.tail(n_x - 1 - i);
+    Kde1d refit(*this);
+    refit.fit(x_minus);
+    loo(i) = refit.pdf(x.segment(i, 1))(0);
+  }
+
+  return loo;
+}
+
+//! computes the leave-one-out log-likelihood of the model.
+//! @param x vector of observations used for fitting the model.
+//! @return the sum of the logarithms of `loo_pdf(x)` (ignoring missing
+//!   values).
+inline double
+Kde1d::loo_loglik(const Eigen::VectorXd& x) const
+{
+  Eigen::ArrayXd loo = loo_pdf(x).array();
+  return loo.isNaN().select(0.0, loo.log()).sum();
 }
 
 //! (analytically) evaluates the kernel density estimate and its influence
@@ -561,103 +1317,194 @@ Kde1d::kern_gauss(const Eigen::VectorXd& x)
 //! @param x_ev evaluation points.
 //! @param x observations.
 //! @param weights vector of weights for each observation (can be empty).
-//! @return a two-column matrix containing the density estimate in the first
-//!   and the influence function in the second column.
+//! @return a three-column matrix containing the density estimate in the
+//!   first, the influence function in the second, and the (unweighted) linear
+//!   bin counts of the observations in the third column.
 inline Eigen::MatrixXd
 Kde1d::fit_lp(const Eigen::VectorXd& x,
               const Eigen::VectorXd& grid_points,
               const Eigen::VectorXd& weights)
 {
   size_t m = grid_points.size();
-  fft::KdeFFT kde_fft(
-    x, bandwidth_, grid_points(0), grid_points(m - 1), weights);
-  Eigen::VectorXd f0 = kde_fft.kde_drv(0);
-  Eigen::VectorXd f1(f0.size()), f2(f0.size());
+  double lower = grid_points(0), upper = grid_points(m - 1);
+  if (static_cast<double>(x.size()) * static_cast<double>(m) <=
+      max_direct_work_) {
+    auto kde = [&] {
+      KDE1D_STAGE(profile_, "binning");
+      return direct::KdeDirect(
+        x, bandwidth_, lower, upper, weights, kernel_, m - 1);
+    }();
+    return fit_lp(kde, x, grid_points, weights);
+  }
+  auto kde = [&] {
+    KDE1D_STAGE(profile_, "binning");
+    return fft::KdeFFT(x, bandwidth_, lower, upper, weights, kernel_, m - 1);
+  }();
+  return fit_lp(kde, x, grid_points, weights);
+}
+
+//! evaluates the estimate for jittered discrete data, which is binned
+//! without materializing it (see `fit_lp(x, grid_points, weights)`).
+//! @param x jittered discrete data.
+//! @param grid_points the grid points.
+inline Eigen::MatrixXd
+Kde1d::fit_lp(const stats::JitteredLevels& x,
+              const Eigen::VectorXd& grid_points)
+{
+  size_t m = grid_points.size();
+  if (static_cast<double>(x.size()) * static_cast<double>(m) <=
+      max_direct_work_) {
+    return fit_lp(x.expand(), grid_points, Eigen::VectorXd());
+  }
+  double lower = grid_points(0), upper = grid_points(m - 1);
+  auto kde = [&] {
+    KDE1D_STAGE(profile_, "binning");
+    return fft::KdeFFT(x, bandwidth_, lower, upper, kernel_, m - 1);
+  }();
+  return fit_lp(kde, x, grid_points, Eigen::VectorXd());
+}
+
+//! evaluates the local polynomial estimate and its influence function at the
+//! grid points of a kernel density (derivative) estimator.
+//! @param kde either an `fft::KdeFFT` or a `direct::KdeDirect` object.
+//! @param x observations (a vector or `stats::JitteredLevels`).
+//! @param grid_points the grid points of `kde`.
+//! @param weights vector of weights for each observation (can be empty).
+//! @return see `fit_lp(x, grid_points, weights)`.
+template<class KdeEstimator, class Data>
+inline Eigen::MatrixXd
+Kde1d::fit_lp(const KdeEstimator& kde,
+              const Data& x,
+              const Eigen::VectorXd& grid_points,
+              const Eigen::VectorXd& weights)
+{
+  Eigen::MatrixXd f;
+  {
+    constexpr bool binned = std::is_same<KdeEstimator, fft::KdeFFT>::value;
+    KDE1D_STAGE(profile_, binned ? "fft" : "direct");
+    f = kde.kde_drvs(static_cast<unsigned>(degree_));
+  }
+  size_t m = f.rows();
 
   Eigen::VectorXd wbin = Eigen::VectorXd::Ones(m);
+  Eigen::VectorXd count = kde.get_bin_counts();
   if (weights.size()) {
     // compute the average weight per cell
-    auto wcount = kde_fft.get_bin_counts();
-    auto count = tools::linbin(x,
-                               grid_points(0),
-                               grid_points(m - 1),
-                               m - 1,
-                               Eigen::VectorXd::Ones(x.size()));
+    auto wcount = count;
+    count =
+      unweighted_bin_counts(x, grid_points(0), grid_points(m - 1), m - 1);
     wbin = wcount.cwiseQuotient(count);
+    // weights are normalized to mean one, use that for empty cells
+    wbin = (count.array() > 0).select(wbin, 1.0);
   }
 
-  Eigen::MatrixXd res(f0.size(), 2);
-  res.col(0) = f0;
-  res.col(1) =
-    K0_ / (static_cast<double>(x.size()) * bandwidth_) * wbin.cwiseQuotient(f0);
-  if (degree_ == 0)
+  Eigen::MatrixXd lp;
+  {
+    KDE1D_STAGE(profile_, "local_polynomial");
+    lp_degree_ = degree_;
+    lp = lp_estimate(f, bandwidth_, lp_degree_);
+    if ((lp_degree_ > 0) && lp.col(0).array().isNaN().all()) {
+      // the local polynomial is degenerate in every window (e.g., for a
+      // single observation); use the local constant estimate instead
+      lp_degree_ = 0;
+      lp = lp_estimate(f, bandwidth_, lp_degree_);
+    }
+  }
+  Eigen::MatrixXd res(m, 3);
+  res.col(0) = lp.col(0);
+  {
+    KDE1D_STAGE(profile_, "influence");
+    res.col(1) =
+      locpoly::inverse_moment00(f, bandwidth_, lp.col(1), lp_degree_);
+    res.col(1) = res.col(1).cwiseProduct(wbin) * kernel_.at_zero() /
+                 (static_cast<double>(x.size()) * bandwidth_);
+  }
+  res.col(2) = count;
+  if (lp_degree_ == 0)
     return res;
 
   // degree > 0
-  f1 = kde_fft.kde_drv(1);
-  Eigen::VectorXd S = Eigen::VectorXd::Constant(f0.size(), bandwidth_);
-  Eigen::VectorXd b = f1.cwiseQuotient(f0);
-  if (degree_ == 2) {
-    f2 = kde_fft.kde_drv(2);
-    // D/R is notation from Hjort and Jones' AoS paper
-    Eigen::VectorXd D = f2.cwiseQuotient(f0) - b.cwiseProduct(b);
-    Eigen::VectorXd R = 1 / (1.0 + bandwidth_ * bandwidth_ * D.array()).sqrt();
-    // this is our notation
-    S = (R / bandwidth_).array().pow(2);
-    b *= bandwidth_ * bandwidth_;
-    res.col(0) = bandwidth_ * S.cwiseSqrt().cwiseProduct(res.col(0));
-  }
-  res.col(0) = res.col(0).array() * (-0.5 * b.array().pow(2) * S.array()).exp();
-
-  for (size_t k = 0; k < m; k++) {
-    res(k, 1) =
-      calculate_infl(x.size(), f0(k), f1(k), f2(k), bandwidth_, S(k), wbin(k));
-    if (std::isnan(res(k, 0)))
-      res.row(k).setZero();
-  }
+  auto nan_fit = res.col(0).array().isNaN();
+  res.col(1) = (nan_fit || res.col(1).array().isNaN()).select(0.0, res.col(1));
+  res.col(0) = nan_fit.select(0.0, res.col(0));
 
   return res;
 }
 
-//! calculate influence for data point for density estimate based on
-//! quantities pre-computed in `fit_lp()`.
-inline double
-Kde1d::calculate_infl(const size_t& n,
-                      const double& f0,
-                      const double& f1,
-                      const double& f2,
-                      const double& bandwidth,
-                      const double& s,
-                      const double& weight)
-{
-  double M_inverse00;
-  double B = bandwidth * bandwidth;
-  if (degree_ == 0) {
-    M_inverse00 = 1 / f0;
-  } else if (degree_ == 1) {
-    Eigen::Matrix2d M;
-    M(0, 0) = f0;
-    M(0, 1) = B * f1;
-    M(1, 0) = M(0, 1);
-    M(1, 1) = f0 * B + B * f1 * f1 * B / f0;
-    M_inverse00 = M.inverse()(0, 0);
+//! computes the local polynomial density estimate from kernel density
+//! (derivative) estimates.
+//! @param f matrix with kernel density estimate and its first `degree`
+//!   derivatives in the columns.
+//! @param bandwidth the bandwidth parameter.
+//! @param degree degree of the local polynomial.
+//! @return a two-column matrix containing the density estimate in the first
+//!   and the local scale `S` (see `locpoly::inverse_moment00()`) in the second
+//!   column.
+inline Eigen::MatrixXd
+Kde1d::lp_estimate(const Eigen::MatrixXd& f,
+                   double bandwidth,
+                   size_t degree) const
+{
+  Eigen::MatrixXd res(f.rows(), 2);
+  res.col(0) = f.col(0);
+  res.col(1).setConstant(bandwidth);
+  if (degree == 0)
+    return res;
+
+  if (degree > 2) {
+    // local polynomial (instead of log-polynomial) fits; in the interior,
+    // they are equivalent to kernels of order 4 (degree 3) and 6 (degree 4)
+    double h2 = bandwidth * bandwidth;
+    res.col(0) -= 0.5 * h2 * f.col(2);
+    if (degree == 4)
+      res.col(0) += 0.125 * h2 * h2 * f.col(4);
+    res.col(0) = res.col(0).cwiseMax(0.0);
+    return res;
+  }
+
+  Eigen::VectorXd b = f.col(1).cwiseQuotient(f.col(0));
+  if (degree == 1) {
+    // local log-linear fit: fhat = f0 * exp(-h^2 (f1 / f0)^2 / 2)
+    res.col(1).setConstant(1.0 / (bandwidth * bandwidth));
   } else {
-    Eigen::Matrix3d M;
-    M(0, 0) = f0;
-    M(0, 1) = B * f1;
-    M(1, 0) = M(0, 1);
-    M(1, 1) = B * f2 * B + B * f0;
-    M(2, 0) = M(1, 1) / 2;
-    M(0, 2) = M(1, 1) / 2;
-    double s2 = B * f1 / f0;
-    M(1, 2) = f0 / 2 * (3 / s * s2 + std::pow(s2, 3));
-    M(2, 1) = M(1, 2);
-    M(2, 2) =
-      f0 / 4 * (3 / (s * s) + 6 / s * std::pow(s2, 2) + std::pow(s2, 4));
-    M_inverse00 = M.inverse()(0, 0);
+    // D/R is notation from Hjort and Jones' AoS paper
+    Eigen::VectorXd D = f.col(2).cwiseQuotient(f.col(0)) - b.cwiseProduct(b);
+    Eigen::ArrayXd R2 = 1.0 + bandwidth * bandwidth * D.array();
+    // R2 is the kernel-weighted variance of the scaled distances to the
+    // observations; it vanishes where a single observation carries all
+    // kernel mass (e.g., an isolated observation in the transformed domain).
+    // It is computed by cancellation from kernel moments with absolute
+    // errors of order eps * max(f0) (the FFT spreads rounding errors over
+    // the grid), so its error is of order eps * max(f0) / f0. Below 100 times
+    // that, its value and sign are rounding noise; treat it like R2 < 0
+    // instead of turning the noise into a spike f0 / sqrt(R2).
+    double noise = 100 * std::numeric_limits<double>::epsilon() *
+                   f.col(0).cwiseAbs().maxCoeff();
+    R2 = (R2 * f.col(0).array() > noise).select(R2, NAN);
+    Eigen::VectorXd R = 1 / R2.sqrt();
+    // this is our notation
+    res.col(1) = (R / bandwidth).array().pow(2);
+    res.col(0) = bandwidth * res.col(1).cwiseSqrt().cwiseProduct(res.col(0));
   }
+  b *= bandwidth * bandwidth;
+  res.col(0) =
+    res.col(0).array() * (-0.5 * b.array().pow(2) * res.col(1).array()).exp();
+
+  return res;
+}
 
-  return K0_ * weight / (static_cast<double>(n) * bandwidth) * M_inverse00;
+//! determines the boundary transformation from the variable type and bounds.
+inline void
+Kde1d::set_boundary_type()
+{
+  if ((type_ == VarType::discrete) || (std::isnan(xmin_) && std::isnan(xmax_)))
+    boundary_type_ = BoundaryType::none;
+  else if (std::isnan(xmax_))
+    boundary_type_ = BoundaryType::left;
+  else if (std::isnan(xmin_))
+    boundary_type_ = BoundaryType::right;
+  else
+    boundary_type_ = BoundaryType::both;
 }
 
 //! transformations for density estimates with bounded support.
@@ -665,42 +1512,59 @@ Kde1d::calculate_infl(const size_t& n,
 //! @param inverse whether the inverse transformation should be applied.
 //! @return the transformed evaluation points.
 inline Eigen::VectorXd
-Kde1d::boundary_transform(const Eigen::VectorXd& x, bool inverse)
+Kde1d::boundary_transform(const Eigen::VectorXd& x, bool inverse) const
 {
-  if (type_ == VarType::discrete) {
-    return x; // no transform for discrete variables
-  }
-
-  Eigen::VectorXd x_new = x;
-  if (!inverse) {
-    if (!std::isnan(xmin_) && !std::isnan(xmax_)) {
-      // two boundaries -> probit transform
-      auto rng = xmax_ - xmin_;
-      x_new = (x.array() - xmin_ + 5e-5 * rng) / (1.0001 * rng);
-      x_new = stats::qnorm(x_new);
-    } else if (!std::isnan(xmin_)) {
-      // left boundary -> log transform
-      x_new = (1e-5 + x.array() - xmin_).log();
-    } else if (!std::isnan(xmax_)) {
-      // right boundary -> negative log transform
-      x_new = (1e-5 + xmax_ - x.array()).log();
+  KDE1D_STAGE(profile_, "boundary_transform");
+  switch (boundary_type_) {
+    default:
+      return x; // no boundary (or discrete variable) -> no transform
+    case BoundaryType::left:
+      return boundary_transform<BoundaryType::left>(x, inverse);
+    case BoundaryType::right:
+      return boundary_transform<BoundaryType::right>(x, inverse);
+    case BoundaryType::both:
+      return boundary_transform<BoundaryType::both>(x, inverse);
+  }
+}
+
+//! boundary transformation for a fixed boundary type; the type is dispatched
+//! once per call of `boundary_transform(x, inverse)`.
+template<BoundaryType boundary>
+inline Eigen::VectorXd
+Kde1d::boundary_transform(const Eigen::VectorXd& x, bool inverse) const
+{
+  Eigen::VectorXd x_new(x.size());
+  if (boundary == BoundaryType::both) {
+    // two boundaries -> probit transform
+    double rng = xmax_ - xmin_;
+    double lower = xmin_ - 5e-5 * rng, scale = 1.0001 * rng;
+    if (!inverse) {
+      x_new = x.unaryExpr([lower, scale](double y) {
+        return stats::detail::qnorm1((y - lower) / scale);
+      });
     } else {
-      // no boundary -> no transform
+      x_new = x.unaryExpr([lower, scale](double y) {
+        return 0.5 * std::erfc(-y / stats::detail::sqrt2) * scale + lower;
+      });
     }
-  } else {
-    if (!std::isnan(xmin_) && !std::isnan(xmax_)) {
-      // two boundaries -> probit transform
-      auto rng = xmax_ - xmin_;
-      x_new = stats::pnorm(x).array() * 1.0001 * rng + xmin_ - 5e-5 * rng;
-    } else if (!std::isnan(xmin_)) {
-      // left boundary -> log transform
-      x_new = x.array().exp() + xmin_ - 1e-5;
-    } else if (!std::isnan(xmax_)) {
-      // right boundary -> negative log transform
-      x_new = -(x.array().exp() - xmax_ - 1e-5);
+  } else if (boundary == BoundaryType::left) {
+    // left boundary -> log transform
+    double shift = xmin_ - 1e-5;
+    if (!inverse) {
+      x_new = (x.array() - shift).log();
+    } else {
+      x_new = x.array().exp() + shift;
+    }
+  } else if (boundary == BoundaryType::right) {
+    // right boundary -> negative log transform
+    double shift = xmax_ + 1e-5;
+    if (!inverse) {
+      x_new = (shift - x.array()).log();
     } else {
-      // no boundary -> no transform
+      x_new = shift - x.array().exp();
     }
+  } else {
+    x_new = x;
   }
 
   return x_new;
@@ -712,51 +1576,68 @@ Kde1d::boundary_transform(const Eigen::VectorXd& x, bool inverse)
 //! @param fhat the density estimate evaluated in the transformed domain.
 //! @return corrected density estimates at `x`.
 inline Eigen::VectorXd
-Kde1d::boundary_correct(const Eigen::VectorXd& x, const Eigen::VectorXd& fhat)
+Kde1d::boundary_correct(const Eigen::VectorXd& x,
+                        const Eigen::VectorXd& fhat) const
 {
-  if (type_ == VarType::discrete) {
-    return fhat; // no transform for discrete variables
+  KDE1D_STAGE(profile_, "boundary_correct");
+  switch (boundary_type_) {
+    default:
+      return fhat; // no boundary (or discrete variable) -> no transform
+    case BoundaryType::left:
+      return boundary_correct<BoundaryType::left>(x, fhat);
+    case BoundaryType::right:
+      return boundary_correct<BoundaryType::right>(x, fhat);
+    case BoundaryType::both:
+      return boundary_correct<BoundaryType::both>(x, fhat);
   }
+}
 
+//! boundary correction for a fixed boundary type; the type is dispatched
+//! once per call of `boundary_correct(x, fhat)`.
+template<BoundaryType boundary>
+inline Eigen::VectorXd
+Kde1d::boundary_correct(const Eigen::VectorXd& x,
+                        const Eigen::VectorXd& fhat) const
+{
   Eigen::VectorXd corr_term(fhat.size());
-  if (!std::isnan(xmin_) && !std::isnan(xmax_)) {
+  if (boundary == BoundaryType::both) {
     // two boundaries -> probit transform
-    auto rng = xmax_ - xmin_;
-    corr_term = (x.array() - xmin_ + 5e-5 * rng) / (xmax_ - xmin_ + 1e-4 * rng);
-    corr_term = stats::dnorm(stats::qnorm(corr_term));
-    corr_term /= (xmax_ - xmin_ + 1e-4 * rng);
-    corr_term = 1.0 / corr_term.array().max(1e-6);
-  } else if (!std::isnan(xmin_)) {
+    double rng = xmax_ - xmin_;
+    double lower = xmin_ - 5e-5 * rng, scale = 1.0001 * rng;
+    corr_term = x.unaryExpr([lower, scale](double y) {
+      double q = stats::detail::qnorm1((y - lower) / scale);
+      double jac = std::exp(-0.5 * q * q) * stats::detail::inv_sqrt_2pi;
+      return 1.0 / std::max(jac / scale, 1e-6);
+    });
+  } else if (boundary == BoundaryType::left) {
     // left boundary -> log transform
     corr_term = 1.0 / (1e-5 + x.array() - xmin_).max(1e-6);
-  } else if (!std::isnan(xmax_)) {
+  } else if (boundary == BoundaryType::right) {
     // right boundary -> negative log transform
     corr_term = 1.0 / (1e-5 + xmax_ - x.array()).max(1e-6);
   } else {
-    // no boundary -> no transform
-    corr_term.fill(1.0);
+    return fhat;
   }
 
-  Eigen::VectorXd f_corr = fhat.cwiseProduct(corr_term);
-  if (std::isnan(xmin_) && !std::isnan(xmax_))
-    f_corr.reverseInPlace();
-
-  return f_corr;
+  return fhat.cwiseProduct(corr_term);
 }
 
 //! constructs a grid later used for interpolation
-//! @param x vector of observations.
-//! @return a grid of size 50.
+//! @param lower the smallest (transformed) observation.
+//! @param upper the largest (transformed) observation.
+//! @return a grid of size `grid_size_` (see `set_grid_size()`).
 inline Eigen::VectorXd
-Kde1d::construct_grid_points(const Eigen::VectorXd& x)
+Kde1d::construct_grid_points(double lower, double upper)
 {
   Eigen::VectorXd rng(2);
-  rng << x.minCoeff(), x.maxCoeff();
-  if (std::isnan(xmin_) && std::isnan(xmax_)) {
+  rng << lower, upper;
+  // without boundaries (or for a single distinct observation), the grid must
+  // extend beyond the data
+  if ((std::isnan(xmin_) && std::isnan(xmax_)) || (lower == upper)) {
     rng(0) -= 4 * bandwidth_;
     rng(1) += 4 * bandwidth_;
   }
-  auto zgrid = Eigen::VectorXd::LinSpaced(401, rng(0), rng(1));
+  auto zgrid = Eigen::VectorXd::LinSpaced(grid_size_, rng(0), rng(1));
   return boundary_transform(zgrid, true);
 }
 
@@ -765,7 +1646,7 @@ Kde1d::construct_grid_points(const Eigen::VectorXd& x)
 inline Eigen::VectorXd
 Kde1d::finalize_grid(Eigen::VectorXd& grid_points)
 {
-  if (std::isnan(xmin_) && !std::isnan(xmax_))
+  if (flips_grid())
     grid_points.reverseInPlace();
   if (!std::isnan(xmin_))
     grid_points(0) = xmin_;
@@ -775,6 +1656,14 @@ Kde1d::finalize_grid(Eigen::VectorXd& grid_points)
   return grid_points;
 }
 
+//! whether the boundary transformation reverses the order of the grid (the
+//! negative log transform for a right boundary only).
+inline bool
+Kde1d::flips_grid() const
+{
+  return boundary_type_ == BoundaryType::right;
+}
+
 //  Bandwidth for Kernel Density Estimation
 //' @param x vector of observations
 //' @param bandwidth bandwidth parameter, NA for automatic selection.
@@ -789,21 +1678,100 @@ Kde1d::select_bandwidth(const Eigen::VectorXd& x,
                         double bandwidth,
                         double multiplier,
                         size_t degree,
-                        const Eigen::VectorXd& weights) const
+                        const Eigen::VectorXd& weights)
 {
+  KDE1D_STAGE(profile_, "bandwidth");
   if (std::isnan(bandwidth)) {
-    bandwidth::PluginBandwidthSelector selector(x, weights);
-    bandwidth = selector.select_bandwidth(degree);
+    bandwidth::PluginBandwidthSelector selector(
+      x, weights, warm_start_, kernel_);
+    bandwidth = run_bandwidth_selector(selector, degree);
   }
 
+  return finalize_bandwidth(bandwidth, multiplier);
+}
+
+//! selects the bandwidth for jittered discrete data (see
+//! `select_bandwidth(x, bandwidth, multiplier, degree, weights)`).
+inline double
+Kde1d::select_bandwidth(const stats::JitteredLevels& x,
+                        double bandwidth,
+                        double multiplier,
+                        size_t degree)
+{
+  KDE1D_STAGE(profile_, "bandwidth");
+  if (std::isnan(bandwidth)) {
+    bandwidth::PluginBandwidthSelector selector(x, warm_start_, kernel_);
+    bandwidth = run_bandwidth_selector(selector, degree);
+  }
+
+  return finalize_bandwidth(bandwidth, multiplier);
+}
+
+//! runs the bandwidth selection method of the model (or reuses the warm
+//! start if the data is close to it).
+//! @param selector the bandwidth selector.
+//! @param degree polynomial degree.
+inline double
+Kde1d::run_bandwidth_selector(bandwidth::PluginBandwidthSelector& selector,
+                              size_t degree)
+{
+  double bandwidth;
+  if (selector.is_close_to_warm_start(warm_start_tol_)) {
+    selection_state_ = warm_start_;
+    bandwidth = warm_start_.bandwidth;
+  } else {
+    switch (bandwidth_method_) {
+      default:
+        bandwidth = selector.select_bandwidth(degree);
+        break;
+      case BandwidthMethod::lscv:
+        bandwidth = selector.select_bandwidth_lscv(degree);
+        break;
+      case BandwidthMethod::sj:
+        bandwidth = selector.select_bandwidth_sj(degree);
+        break;
+    }
+    selection_state_ = selector.get_state();
+  }
+  warm_start_ = bandwidth::WarmStart();
+
+  return bandwidth;
+}
+
+//! applies the multiplier and, for discrete data, the minimal bandwidth.
+//! @param bandwidth the selected bandwidth.
+//! @param multiplier bandwidth multiplier.
+inline double
+Kde1d::finalize_bandwidth(double bandwidth, double multiplier) const
+{
   bandwidth *= multiplier;
   if (type_ == VarType::discrete) {
-    bandwidth = std::max(bandwidth, 0.5 / 5);
+    bandwidth = std::max(bandwidth, 0.5 / kernel_.support());
   }
 
   return bandwidth;
 }
 
+//! linear bin counts of the observations with unit weights.
+inline Eigen::VectorXd
+Kde1d::unweighted_bin_counts(const Eigen::VectorXd& x,
+                             double lower,
+                             double upper,
+                             size_t num_bins)
+{
+  return tools::linbin(x, lower, upper, num_bins, Eigen::VectorXd());
+}
+
+//! linear bin counts of jittered discrete data.
+inline Eigen::VectorXd
+Kde1d::unweighted_bin_counts(const stats::JitteredLevels& x,
+                             double lower,
+                             double upper,
+                             size_t num_bins)
+{
+  return x.linbin(lower, upper, num_bins);
+}
+
 inline void
 Kde1d::check_xmin_xmax(const double& xmin, const double& xmax) const
 {
@@ -814,7 +1782,7 @@ Kde1d::check_xmin_xmax(const double& xmin, const double& xmax) const
 inline void
 Kde1d::check_fitted() const
 {
-  if (std::isnan(loglik_)) {
+  if (!fitted_) {
     throw std::runtime_error("You must first fit the KDE to data.");
   }
 }
@@ -822,14 +1790,39 @@ Kde1d::check_fitted() const
 inline void
 Kde1d::check_notfitted() const
 {
-  if (!std::isnan(loglik_)) {
+  if (fitted_) {
     throw std::runtime_error(
       "This method can't be used for already fitted objects.");
   }
 }
 
+//! computes the log-likelihood and effective degrees of freedom from the
+//! observations kept by the fit, exactly once for all threads and copies
+//! sharing the fit; the observations are freed afterwards.
+inline const Kde1d::FitStats&
+Kde1d::fit_stats() const
+{
+  FitStats& cache = *fit_stats_;
+  std::call_once(cache.computed, [&] {
+    if (cache.observations.size() == 0)
+      return;
+    {
+      KDE1D_STAGE(profile_, "loglik");
+      cache.loglik = this->logpdf(cache.observations, false).sum();
+    }
+    {
+      KDE1D_STAGE(profile_, "edf");
+      Eigen::VectorXd influences =
+        infl_grid_.interpolate(cache.observations).array() * (1 - prob0_);
+      cache.edf = influences.sum() + (prob0_ > 0);
+    }
+    cache.observations = Eigen::VectorXd();
+  });
+  return cache;
+}
+
 inline void
-Kde1d::check_inputs(const Eigen::VectorXd& x,
+Kde1d::check_inputs(const Eigen::Ref<const Eigen::VectorXd>& x,
                     const Eigen::VectorXd& weights) const
 {
   if (x.size() == 0)
@@ -840,13 +1833,51 @@ Kde1d::check_inputs(const Eigen::VectorXd& x,
 }
 
 inline void
-Kde1d::check_boundaries(const Eigen::VectorXd& x) const
+Kde1d::check_boundaries(const Eigen::Ref<const Eigen::VectorXd>& x) const
 {
   if ((x.array() < xmin_).any() || (x.array() > xmax_).any()) {
     throw std::invalid_argument("x must be contained in [xmin, xmax].");
   }
 }
 
+//! removes missing values, normalizes the weights, removes the zeros of
+//! zero-inflated and jitters discrete data.
+//! @param x vector of observations.
+//! @param weights vector of weights for each observation (can be empty).
+//! @param jitter whether discrete data are jittered.
+//! @return the (weighted) proportion of zeros for zero-inflated data, zero
+//!   otherwise.
+inline double
+Kde1d::prepare_data(Eigen::VectorXd& x,
+                    Eigen::VectorXd& weights,
+                    bool jitter) const
+{
+  {
+    KDE1D_STAGE(profile_, "remove_nans");
+    tools::remove_nans(x, weights);
+    if (weights.size() > 0)
+      weights /= weights.mean();
+  }
+
+  double prob0 = 0.0;
+  if (type_ == VarType::zero_inflated) {
+    KDE1D_STAGE(profile_, "zero_inflation");
+    if (weights.size() == 0)
+      weights = Eigen::VectorXd::Ones(x.size());
+    weights =
+      (x.array() == 0.0).select(Eigen::VectorXd::Zero(x.size()), weights);
+    prob0 = 1 - weights.mean();
+    x = (weights.array() == 0.0)
+          .select(Eigen::VectorXd::Constant(x.size(), NAN), x);
+    tools::remove_nans(x, weights);
+  } else if ((type_ == VarType::discrete) && jitter) {
+    KDE1D_STAGE(profile_, "jitter");
+    x = stats::equi_jitter(x);
+  }
+
+  return prob0;
+}
+
 void
 Kde1d::set_interpolation_grid(const interp::InterpolationGrid& grid)
 {
@@ -860,6 +1891,7 @@ Kde1d::set_xmin_xmax(double xmin, double xmax)
   this->check_xmin_xmax(xmin, xmax);
   xmin_ = xmin;
   xmax_ = xmax;
+  this->set_boundary_type();
 }
 
 std::string
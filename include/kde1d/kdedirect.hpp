@@ -0,0 +1,270 @@
+#pragma once
+
+#include "kernel.hpp"
+#include "stats.hpp"
+#include "tools.hpp"
+#include <numeric>
+#include <vector>
+
+namespace kde1d {
+
+namespace direct {
+
+//! Exact kernel density (derivative) estimates on an equally spaced grid.
+//! Has the same interface as `fft::KdeFFT`, but evaluates the kernel sums
+//! directly (with the Gaussian kernel truncated at +/- 5 bandwidths). The
+//! cost is O(n m) for n observations and m grid points, so this is only
+//! useful for small samples.
+class KdeDirect
+{
+public:
+  KdeDirect(const Eigen::VectorXd& x,
+            double bandwidth,
+            double lower,
+            double upper,
+            const Eigen::VectorXd& weights = Eigen::VectorXd(),
+            const Kernel& kernel = Kernel(),
+            size_t num_bins = 400);
+
+  Eigen::VectorXd kde_drv(unsigned drv) const;
+  Eigen::MatrixXd kde_drvs(unsigned max_drv) const;
+  Eigen::VectorXd get_bin_counts() const { return bin_counts_; };
+  double get_bin_width() const
+  {
+    return (upper_ - lower_) / static_cast<double>(num_bins_);
+  };
+  void set_bandwidth(double bandwidth) { bandwidth_ = bandwidth; };
+
+private:
+  double bandwidth_;
+  double lower_;
+  double upper_;
+  Kernel kernel_;
+  size_t num_bins_;
+  Eigen::VectorXd x_;
+  Eigen::VectorXd w_;
+  Eigen::VectorXd bin_counts_;
+};
+
+//! @param x vector of observations.
+//! @param bandwidth the bandwidth parameter.
+//! @param lower lower bound of the grid.
+//! @param upper upper bound of the grid.
+//! @param weights optional vector of weights for each observation.
+//! @param kernel the kernel function (Gaussian by default).
+//! @param num_bins number of bins; the grid has `num_bins + 1` points.
+inline KdeDirect::KdeDirect(const Eigen::VectorXd& x,
+                            double bandwidth,
+                            double lower,
+                            double upper,
+                            const Eigen::VectorXd& weights,
+                            const Kernel& kernel,
+                            size_t num_bins)
+  : bandwidth_(bandwidth)
+  , lower_(lower)
+  , upper_(upper)
+  , kernel_(kernel)
+  , num_bins_(num_bins)
+{
+  if (num_bins == 0)
+    throw std::invalid_argument("num_bins must be positive");
+  if (weights.size() > 0 && (weights.size() != x.size()))
+    throw std::invalid_argument("x and weights must have the same size");
+
+  Eigen::VectorXd w;
+  if (weights.size() > 0) {
+    w = weights / weights.mean();
+  } else {
+    w = Eigen::VectorXd::Ones(x.size());
+  }
+  bin_counts_ = tools::linbin(x, lower_, upper_, num_bins_, w);
+
+  x_ = x;
+  w_ = w;
+}
+
+//! Exact kernel density derivative estimate
+//! @param drv order of derivative.
+//! @return estimated derivative evaluated at the grid points.
+inline Eigen::VectorXd
+KdeDirect::kde_drv(unsigned drv) const
+{
+  return kde_drvs(drv).col(drv);
+}
+
+//! Exact kernel density derivative estimates
+//!
+//! Since the grid is equally spaced, the kernel values of an observation at
+//! consecutive grid points satisfy
+//! \f$ \phi(u + d) = \phi(u) e^{-u d - d^2 / 2} \f$, where \f$ d \f$ is the
+//! grid spacing in units of the bandwidth. Only one exponential per
+//! observation is therefore needed; the derivatives follow from the
+//! recurrence in `stats::dnorm_drvs()`. Other kernels are evaluated
+//! directly.
+//! @param max_drv highest order of derivative.
+//! @return matrix whose `k`-th column contains the `k`-th derivative of the
+//!   estimate evaluated at the grid points.
+inline Eigen::MatrixXd
+KdeDirect::kde_drvs(unsigned max_drv) const
+{
+  double delta = (upper_ - lower_) / static_cast<double>(num_bins_);
+  double d = delta / bandwidth_;
+  double q = std::exp(-d * d);
+  double radius = kernel_.support() * bandwidth_;
+  bool gaussian = (kernel_.get_type() == KernelType::gaussian);
+
+  // first grid point within the kernel's support for each observation
+  Eigen::ArrayXd first = (x_.array() - radius - lower_) / delta;
+  first = first.ceil().max(0.0);
+  Eigen::ArrayXd u0 = (lower_ + first * delta - x_.array()) / bandwidth_;
+  Eigen::ArrayXd phi0 = stats::kern_gauss(u0.matrix()).array() * w_.array();
+
+  // derivatives are accumulated in the columns of res, one per grid point
+  Eigen::MatrixXd res = Eigen::MatrixXd::Zero(max_drv + 1, num_bins_ + 1);
+  for (Eigen::Index i = 0; i < x_.size(); ++i) {
+    double last = (x_(i) + radius - lower_) / delta;
+    last = std::min(std::floor(last), static_cast<double>(num_bins_));
+    if (!(first(i) <= last))
+      continue;
+
+    if (!gaussian) {
+      auto k0 = static_cast<Eigen::Index>(first(i));
+      auto len = static_cast<Eigen::Index>(last) - k0 + 1;
+      Eigen::ArrayXd steps =
+        Eigen::ArrayXd::LinSpaced(len, 0.0, last - first(i));
+      Eigen::VectorXd u = u0(i) + steps * d;
+      res.middleCols(k0, len) += w_(i) * kernel_.drvs(u, max_drv).transpose();
+      continue;
+    }
+
+    double phi = phi0(i);
+    double r = std::exp(-u0(i) * d - 0.5 * d * d);
+    auto k0 = static_cast<size_t>(first(i));
+    for (size_t k = k0; k <= static_cast<size_t>(last); ++k) {
+      double u = u0(i) + static_cast<double>(k - k0) * d;
+      double* out = res.col(k).data();
+      double p0 = phi, p1 = -u * phi;
+      out[0] += p0;
+      if (max_drv > 0)
+        out[1] += p1;
+      for (unsigned drv = 1; drv < max_drv; ++drv) {
+        double p2 = -u * p1 - static_cast<double>(drv) * p0;
+        out[drv + 1] += p2;
+        p0 = p1;
+        p1 = p2;
+      }
+      phi *= r;
+      r *= q;
+    }
+  }
+
+  double n_eff = w_.sum();
+  for (unsigned drv = 0; drv <= max_drv; ++drv)
+    res.row(drv) /= n_eff * std::pow(bandwidth_, drv + 1.0);
+
+  return res.transpose();
+}
+
+//! Exact kernel density derivative estimates at arbitrary points
+//!
+//! Observations and evaluation points are sorted and swept with two pointers
+//! delimiting the observations within the kernel's support (+/- 5
+//! bandwidths for the Gaussian kernel). The cost is
+//! O((n + m) log(n + m) + m k), where k is the average number of observations
+//! within the support of a kernel.
+//! @param x_ev evaluation points.
+//! @param x observations.
+//! @param bandwidth the bandwidth parameter.
+//! @param max_drv highest order of derivative.
+//! @param weights optional vector of weights for each observation.
+//! @param kernel the kernel function (Gaussian by default).
+//! @return matrix whose `k`-th column contains the `k`-th derivative of the
+//!   estimate evaluated at `x_ev` (NaN where `x_ev` is NaN).
+inline Eigen::MatrixXd
+kde_drvs(const Eigen::VectorXd& x_ev,
+         const Eigen::VectorXd& x,
+         double bandwidth,
+         unsigned max_drv,
+         const Eigen::VectorXd& weights = Eigen::VectorXd(),
+         const Kernel& kernel = Kernel())
+{
+  if (weights.size() > 0 && (weights.size() != x.size()))
+    throw std::invalid_argument("x and weights must have the same size");
+
+  auto sorted_indices = [](const Eigen::VectorXd& v) {
+    std::vector<size_t> ind;
+    ind.reserve(v.size());
+    for (Eigen::Index i = 0; i < v.size(); ++i) {
+      if (!std::isnan(v(i)))
+        ind.push_back(i);
+    }
+    std::sort(ind.begin(), ind.end(), [&v](size_t i, size_t j) {
+      return v(i) < v(j);
+    });
+    return ind;
+  };
+  std::vector<size_t> ind_x = sorted_indices(x);
+  std::vector<size_t> ind_ev = sorted_indices(x_ev);
+
+  Eigen::VectorXd xs(ind_x.size()), ws(ind_x.size());
+  for (size_t i = 0; i < ind_x.size(); ++i) {
+    xs(i) = x(ind_x[i]);
+    ws(i) = (weights.size() > 0) ? weights(ind_x[i]) : 1.0;
+  }
+  double norm = ws.sum();
+
+  // coefficients of the probabilists' Hermite polynomials (rows), so that
+  // phi^(k)(u) = (-1)^k sum_j herm(k, j) u^j phi(u)
+  Eigen::MatrixXd herm = Eigen::MatrixXd::Zero(max_drv + 1, max_drv + 1);
+  herm(0, 0) = 1.0;
+  for (unsigned k = 1; k <= max_drv; ++k) {
+    herm.block(k, 1, 1, k) = herm.block(k - 1, 0, 1, k);
+    if (k > 1)
+      herm.row(k) -= static_cast<double>(k - 1) * herm.row(k - 2);
+  }
+  for (unsigned k = 1; k <= max_drv; k += 2)
+    herm.row(k) *= -1.0;
+
+  // sweep; the kernel-weighted moments of u in the window are accumulated
+  // and converted to derivatives
+  Eigen::MatrixXd res =
+    Eigen::MatrixXd::Constant(x_ev.size(), max_drv + 1, NAN);
+  Eigen::VectorXd moments(max_drv + 1);
+  Eigen::ArrayXd u(xs.size()), p(xs.size());
+  double radius = kernel.support() * bandwidth;
+  bool gaussian = (kernel.get_type() == KernelType::gaussian);
+  Eigen::Index n = xs.size(), lo = 0, hi = 0;
+  for (size_t j : ind_ev) {
+    double e = x_ev(j);
+    while ((lo < n) && (xs(lo) < e - radius))
+      ++lo;
+    hi = std::max(hi, lo);
+    while ((hi < n) && (xs(hi) <= e + radius))
+      ++hi;
+
+    Eigen::Index len = hi - lo;
+    u.head(len) = (e - xs.segment(lo, len).array()) / bandwidth;
+    if (!gaussian) {
+      res.row(j) = ws.segment(lo, len).transpose() *
+                   kernel.drvs(u.head(len).matrix(), max_drv);
+      continue;
+    }
+    p.head(len) = stats::kern_gauss(u.head(len).matrix()).array();
+    p.head(len) *= ws.segment(lo, len).array();
+    moments(0) = p.head(len).sum();
+    for (unsigned k = 1; k <= max_drv; ++k) {
+      p.head(len) *= u.head(len);
+      moments(k) = p.head(len).sum();
+    }
+    res.row(j) = (herm * moments).transpose();
+  }
+
+  for (unsigned drv = 0; drv <= max_drv; ++drv)
+    res.col(drv) /= norm * std::pow(bandwidth, drv + 1.0);
+
+  return res;
+}
+
+} // end kde1d::direct
+
+} // end kde1d
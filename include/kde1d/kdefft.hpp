@@ -1,7 +1,9 @@
 #pragma once
 
+#include "kernel.hpp"
 #include "stats.hpp"
 #include "tools.hpp"
+#include <map>
 #include <unsupported/Eigen/FFT>
 
 namespace kde1d {
@@ -12,6 +14,10 @@ namespace fft {
 //! Methodology is similar to Sheather and Jones(1991), but asymptotic
 //! bias/variance expressions are adapted for higher-order polynomials and
 //! nearest neighbor bandwidths.
+//!
+//! Kernel taps and the Fourier transform of the bin counts are cached in the
+//! object, so `kde_drv()` must not be called concurrently on the same
+//! instance.
 class KdeFFT
 {
 public:
@@ -19,18 +25,43 @@ public:
          double bandwidth,
          double lower,
          double upper,
-         const Eigen::VectorXd& weights = Eigen::VectorXd());
+         const Eigen::VectorXd& weights = Eigen::VectorXd(),
+         const Kernel& kernel = Kernel(),
+         size_t num_bins = 400);
+  KdeFFT(const stats::JitteredLevels& x,
+         double bandwidth,
+         double lower,
+         double upper,
+         const Kernel& kernel = Kernel(),
+         size_t num_bins = 400);
 
   Eigen::VectorXd kde_drv(unsigned drv) const;
+  Eigen::MatrixXd kde_drvs(unsigned max_drv) const;
   Eigen::VectorXd get_bin_counts() const { return bin_counts_; };
+  double get_bin_width() const
+  {
+    return (upper_ - lower_) / static_cast<double>(num_bins_);
+  };
   void set_bandwidth(double bandwidth) { bandwidth_ = bandwidth; };
 
 private:
+  const Eigen::MatrixXd& kernel_taps(unsigned drv) const;
+  const Eigen::VectorXcd& bin_counts_fft(size_t fft_size) const;
+
   double bandwidth_;
   double lower_;
   double upper_;
-  static constexpr size_t num_bins_{ 400 };
+  Kernel kernel_;
+  size_t num_bins_;
+  static constexpr unsigned min_taps_drv_{ 4 };
   Eigen::VectorXd bin_counts_;
+
+  // caches for kernel taps (valid for taps_bandwidth_) and the Fourier
+  // transform of the bin counts (keyed by the FFT size)
+  mutable double taps_bandwidth_{ NAN };
+  mutable Eigen::MatrixXd taps_;
+  mutable std::map<size_t, Eigen::VectorXcd> bin_counts_fft_;
+  mutable Eigen::FFT<double> fft_;
 };
 
 //! @param x vector of observations.
@@ -38,42 +69,70 @@ private:
 //! @param lower lower bound of the grid.
 //! @param upper bound of the grid.
 //! @param weigths optional vector of weights for each observation.
+//! @param kernel the kernel function (Gaussian by default).
+//! @param num_bins number of bins; the grid has `num_bins + 1` points.
 inline KdeFFT::KdeFFT(const Eigen::VectorXd& x,
                       double bandwidth,
                       double lower,
                       double upper,
-                      const Eigen::VectorXd& weights)
+                      const Eigen::VectorXd& weights,
+                      const Kernel& kernel,
+                      size_t num_bins)
   : bandwidth_(bandwidth)
   , lower_(lower)
   , upper_(upper)
+  , kernel_(kernel)
+  , num_bins_(num_bins)
 {
+  if (num_bins == 0)
+    throw std::invalid_argument("num_bins must be positive");
   if (weights.size() > 0 && (weights.size() != x.size()))
     throw std::invalid_argument("x and weights must have the same size");
 
+  // unweighted data is binned without materializing unit weights
   Eigen::VectorXd w;
-  if (weights.size() > 0) {
+  if (weights.size() > 0)
     w = weights / weights.mean();
-  } else {
-    w = Eigen::VectorXd::Ones(x.size());
-  }
   bin_counts_ = tools::linbin(x, lower_, upper_, num_bins_, w);
 }
 
+//! @param x jittered discrete data, binned without materializing it.
+//! @param bandwidth the bandwidth parameter.
+//! @param lower lower bound of the grid.
+//! @param upper bound of the grid.
+//! @param kernel the kernel function (Gaussian by default).
+//! @param num_bins number of bins; the grid has `num_bins + 1` points.
+inline KdeFFT::KdeFFT(const stats::JitteredLevels& x,
+                      double bandwidth,
+                      double lower,
+                      double upper,
+                      const Kernel& kernel,
+                      size_t num_bins)
+  : bandwidth_(bandwidth)
+  , lower_(lower)
+  , upper_(upper)
+  , kernel_(kernel)
+  , num_bins_(num_bins)
+{
+  if (num_bins == 0)
+    throw std::invalid_argument("num_bins must be positive");
+  bin_counts_ = x.linbin(lower_, upper_, num_bins_);
+}
+
 //! Binned kernel density derivative estimate
 //! @param drv order of derivative.
 //! @return estimated derivative evaluated at the bin centers.
 inline Eigen::VectorXd
 KdeFFT::kde_drv(unsigned drv) const
 {
-  double delta = (upper_ - lower_) / num_bins_;
-  double tau = 4.0 + drv;
+  double delta = (upper_ - lower_) / static_cast<double>(num_bins_);
+  double tau = kernel_.binned_support(drv);
   size_t L = static_cast<size_t>(std::floor(tau * bandwidth_ / delta));
   L = std::min(L, num_bins_ + 1);
 
-  double tmp_dbl = static_cast<double>(L) * delta / bandwidth_;
-  Eigen::VectorXd arg = Eigen::VectorXd::LinSpaced(L + 1, 0.0, tmp_dbl);
-  tmp_dbl = std::pow(bandwidth_, drv + 1.0);
-  arg = stats::dnorm_drv(arg, drv) / (tmp_dbl * bin_counts_.sum());
+  double tmp_dbl = std::pow(bandwidth_, drv + 1.0);
+  Eigen::VectorXd arg = kernel_taps(drv).col(drv).head(L + 1);
+  arg /= tmp_dbl * bin_counts_.sum();
 
   tmp_dbl = static_cast<double>(num_bins_ + L) + 2.0;
   tmp_dbl = std::pow(2, std::ceil(std::log(tmp_dbl) / std::log(2)));
@@ -83,17 +142,66 @@ KdeFFT::kde_drv(unsigned drv) const
   arg2.head(L + 1) = arg;
   arg2.tail(L) = arg.tail(L).reverse() * (drv % 2 ? -1.0 : 1.0);
 
-  Eigen::VectorXd x2 = Eigen::VectorXd::Zero(P);
-  x2.head(num_bins_ + 1) = bin_counts_;
-
-  Eigen::FFT<double> fft;
-  Eigen::VectorXcd tmp1 = fft.fwd(arg2);
-  Eigen::VectorXcd tmp2 = fft.fwd(x2);
-  tmp1 = tmp1.cwiseProduct(tmp2);
-  tmp2 = fft.inv(tmp1);
+  Eigen::VectorXcd tmp1 = fft_.fwd(arg2);
+  tmp1 = tmp1.cwiseProduct(bin_counts_fft(P));
+  Eigen::VectorXcd tmp2 = fft_.inv(tmp1);
   return tmp2.head(num_bins_ + 1).real();
 }
 
+//! Binned kernel density derivative estimates
+//! @param max_drv highest order of derivative.
+//! @return matrix whose `k`-th column contains the `k`-th derivative of the
+//!   estimate evaluated at the bin centers.
+inline Eigen::MatrixXd
+KdeFFT::kde_drvs(unsigned max_drv) const
+{
+  Eigen::MatrixXd res(num_bins_ + 1, max_drv + 1);
+  for (unsigned drv = 0; drv <= max_drv; ++drv)
+    res.col(drv) = kde_drv(drv);
+  return res;
+}
+
+//! kernel taps at multiples of the bin width (in units of the bandwidth)
+//!
+//! The taps for all derivative orders up to `max(drv, 4)` (or the highest
+//! order the kernel supports) are generated in one pass and reused until the
+//! bandwidth changes.
+//! @param drv highest order of derivative needed.
+//! @return matrix whose `k`-th column contains the `k`-th derivative of the
+//!   kernel at `j * delta / bandwidth`, `j = 0, 1, ...`.
+inline const Eigen::MatrixXd&
+KdeFFT::kernel_taps(unsigned drv) const
+{
+  if ((bandwidth_ != taps_bandwidth_) || (taps_.cols() <= drv)) {
+    unsigned max_drv = std::max(drv, min_taps_drv_);
+    max_drv = std::min(max_drv, std::max(drv, kernel_.max_drv()));
+    double delta = (upper_ - lower_) / static_cast<double>(num_bins_);
+    double tau = kernel_.binned_support(max_drv);
+    size_t L = static_cast<size_t>(std::floor(tau * bandwidth_ / delta));
+    L = std::min(L, num_bins_ + 1);
+    Eigen::VectorXd arg(L + 1);
+    for (size_t j = 0; j <= L; ++j)
+      arg(j) = static_cast<double>(j) * delta / bandwidth_;
+    taps_ = kernel_.drvs(arg, max_drv);
+    taps_bandwidth_ = bandwidth_;
+  }
+  return taps_;
+}
+
+//! Fourier transform of the zero-padded bin counts.
+//! @param fft_size size of the transform.
+inline const Eigen::VectorXcd&
+KdeFFT::bin_counts_fft(size_t fft_size) const
+{
+  auto it = bin_counts_fft_.find(fft_size);
+  if (it == bin_counts_fft_.end()) {
+    Eigen::VectorXd x2 = Eigen::VectorXd::Zero(fft_size);
+    x2.head(num_bins_ + 1) = bin_counts_;
+    it = bin_counts_fft_.emplace(fft_size, fft_.fwd(x2)).first;
+  }
+  return it->second;
+}
+
 } // end kde1d::bandwidth
 
 } // end kde1d
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "stats.hpp"
+#include <limits>
+#include <stdexcept>
+
+namespace kde1d {
+
+//! kernel functions.
+enum class KernelType
+{
+  gaussian,
+  epanechnikov,
+  biweight
+};
+
+//! A kernel function and the constants needed for density estimation.
+//!
+//! The Gaussian kernel has unbounded support and is truncated at a number of
+//! bandwidths that depends on the order of the derivative. The Epanechnikov
+//! kernel \f$ 3/4 (1 - u^2) \f$ and the biweight kernel
+//! \f$ 15/16 (1 - u^2)^2 \f$ vanish outside of \f$ [-1, 1] \f$, so binned
+//! estimates need far fewer kernel taps. Their derivatives are only available
+//! up to the order where they are continuous.
+class Kernel
+{
+public:
+  Kernel(KernelType type = KernelType::gaussian)
+    : type_(type)
+  {}
+
+  KernelType get_type() const { return type_; }
+  Eigen::MatrixXd drvs(const Eigen::VectorXd& u, unsigned max_drv) const;
+  unsigned max_drv() const;
+  double support() const;
+  double binned_support(unsigned drv) const;
+  double at_zero() const;
+  double roughness() const;
+  double variance() const;
+  double canonical_bandwidth() const;
+
+private:
+  KernelType type_;
+};
+
+//! evaluates the kernel and its derivatives.
+//! @param u evaluation points (in units of the bandwidth).
+//! @param max_drv highest order of the derivative; must not exceed
+//!   `max_drv()`.
+//! @return matrix with `max_drv + 1` columns; column `k` contains the `k`-th
+//!   derivative evaluated at `u`.
+inline Eigen::MatrixXd
+Kernel::drvs(const Eigen::VectorXd& u, unsigned max_drv) const
+{
+  if (max_drv > this->max_drv())
+    throw std::invalid_argument("kernel is not differentiable that often.");
+  if (type_ == KernelType::gaussian)
+    return stats::dnorm_drvs(u, max_drv);
+
+  Eigen::ArrayXd u2 = u.array().square();
+  Eigen::MatrixXd res(u.size(), max_drv + 1);
+  if (type_ == KernelType::epanechnikov) {
+    res.col(0) = 0.75 * (1 - u2);
+    if (max_drv > 0)
+      res.col(1) = -1.5 * u;
+  } else {
+    res.col(0) = 0.9375 * (1 - u2).square();
+    if (max_drv > 0)
+      res.col(1) = -3.75 * u.array() * (1 - u2);
+    if (max_drv > 1)
+      res.col(2) = -3.75 * (1 - 3 * u2);
+  }
+  for (unsigned drv = 0; drv <= max_drv; ++drv)
+    res.col(drv) = (u2 > 1.0).select(0.0, res.col(drv));
+
+  return res;
+}
+
+//! highest order of derivative that is available.
+inline unsigned
+Kernel::max_drv() const
+{
+  switch (type_) {
+    case KernelType::epanechnikov:
+      return 1;
+    case KernelType::biweight:
+      return 2;
+    default:
+      return std::numeric_limits<unsigned>::max();
+  }
+}
+
+//! radius (in units of the bandwidth) beyond which the kernel vanishes; the
+//! Gaussian kernel is truncated at 5 (see `stats::kern_gauss()`).
+inline double
+Kernel::support() const
+{
+  return (type_ == KernelType::gaussian) ? 5.0 : 1.0;
+}
+
+//! radius (in units of the bandwidth) beyond which the `drv`-th derivative of
+//! the kernel is ignored in binned estimates.
+//! @param drv order of the derivative.
+inline double
+Kernel::binned_support(unsigned drv) const
+{
+  return (type_ == KernelType::gaussian) ? 4.0 + drv : 1.0;
+}
+
+//! the kernel evaluated at zero.
+inline double
+Kernel::at_zero() const
+{
+  switch (type_) {
+    case KernelType::epanechnikov:
+      return 0.75;
+    case KernelType::biweight:
+      return 0.9375;
+    default:
+      return stats::detail::inv_sqrt_2pi;
+  }
+}
+
+//! the roughness \f$ R(K) = \int K(u)^2 du \f$ of the kernel.
+inline double
+Kernel::roughness() const
+{
+  switch (type_) {
+    case KernelType::epanechnikov:
+      return 0.6;
+    case KernelType::biweight:
+      return 5.0 / 7.0;
+    default:
+      return stats::detail::inv_sqrt_2pi / stats::detail::sqrt2;
+  }
+}
+
+//! the variance \f$ \mu_2(K) = \int u^2 K(u) du \f$ of the kernel.
+inline double
+Kernel::variance() const
+{
+  switch (type_) {
+    case KernelType::epanechnikov:
+      return 0.2;
+    case KernelType::biweight:
+      return 1.0 / 7.0;
+    default:
+      return 1.0;
+  }
+}
+
+//! the canonical bandwidth \f$ (R(K) / \mu_2(K)^2)^{1/5} \f$ of the kernel
+//! (Marron and Nolan, 1988). Optimal bandwidths for two kernels are
+//! proportional to their canonical bandwidths.
+inline double
+Kernel::canonical_bandwidth() const
+{
+  return std::pow(roughness() / (variance() * variance()), 0.2);
+}
+
+} // end kde1d
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <Eigen/Dense>
+
+namespace kde1d {
+
+namespace locpoly {
+
+//! computes the upper left element of the inverse of the (local) moment
+//! matrix M of a local polynomial fit, which determines the influence of an
+//! observation on the estimate (Hjort and Jones, 1996).
+//!
+//! For degrees up to 2, M is symmetric and at most 3x3, so the element is
+//! computed in closed form via cofactors, simultaneously for all grid points.
+//! For the local polynomial fits of degree 3 and 4, M is `f0` times the
+//! moment matrix of the Gaussian kernel, whose inverse is known.
+//! @param f matrix with kernel density estimate and its first `degree`
+//!   derivatives in the columns.
+//! @param bandwidth the bandwidth parameter.
+//! @param s the local scale (see `Kde1d::lp_estimate()`); only used for
+//!   `degree = 2`.
+//! @param degree degree of the local polynomial.
+//! @return a vector containing \f$ (M^{-1})_{00} \f$ for each row of `f`.
+inline Eigen::VectorXd
+inverse_moment00(const Eigen::MatrixXd& f,
+                 double bandwidth,
+                 const Eigen::VectorXd& s,
+                 size_t degree)
+{
+  Eigen::ArrayXd f0 = f.col(0);
+  if (degree == 0)
+    return f0.inverse();
+  if (degree == 3)
+    return 1.5 * f0.inverse();
+  if (degree == 4)
+    return 1.875 * f0.inverse();
+
+  double B = bandwidth * bandwidth;
+  Eigen::ArrayXd f1 = f.col(1);
+  Eigen::ArrayXd m01 = B * f1;
+  if (degree == 1) {
+    Eigen::ArrayXd m11 = B * f0 + B * B * f1.square() / f0;
+    return m11 / (f0 * m11 - m01.square());
+  }
+
+  // degree 2
+  Eigen::ArrayXd si = s.array().inverse();
+  Eigen::ArrayXd s2 = B * f1 / f0;
+  Eigen::ArrayXd m11 = B * B * f.col(2).array() + B * f0;
+  Eigen::ArrayXd m02 = m11 / 2;
+  Eigen::ArrayXd m12 = f0 / 2 * (3 * si * s2 + s2.cube());
+  Eigen::ArrayXd m22 =
+    f0 / 4 * (3 * si.square() + 6 * si * s2.square() + s2.square().square());
+
+  Eigen::ArrayXd c00 = m11 * m22 - m12.square();
+  Eigen::ArrayXd c01 = m01 * m22 - m12 * m02;
+  Eigen::ArrayXd c02 = m01 * m12 - m11 * m02;
+  return c00 / (f0 * c00 - m01 * c01 + m02 * c02);
+}
+
+} // end kde1d::locpoly
+
+} // end kde1d
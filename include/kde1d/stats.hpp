@@ -1,12 +1,14 @@
 #pragma once
 
-#define BOOST_MATH_PROMOTE_DOUBLE_POLICY false
 #include "tools.hpp"
 #include <Eigen/Dense>
 #include <algorithm>
-#include <boost/math/distributions.hpp>
-#include <boost/math/special_functions/hermite.hpp>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <random>
+#include <unordered_map>
 #include <vector>
 
 namespace kde1d {
@@ -14,35 +16,167 @@ namespace kde1d {
 //! statistical functions
 namespace stats {
 
+namespace detail {
+
+//! sqrt(2)
+static constexpr double sqrt2 = 1.41421356237309504880;
+
+//! 1 / sqrt(2 * pi)
+static constexpr double inv_sqrt_2pi = 0.398942280401432677940;
+
+//! standard normal quantile of a single probability.
+//!
+//! Uses Wichura's algorithm AS 241 (PPND16), which is accurate to about
+//! 1e-16 relative.
+//! @param p probability.
+//! @return the quantile; -inf/inf for p = 0/1 and NaN outside [0, 1].
+inline double
+qnorm1(double p)
+{
+  if (!(p >= 0.0 && p <= 1.0))
+    return std::numeric_limits<double>::quiet_NaN();
+  if (p == 0.0)
+    return -std::numeric_limits<double>::infinity();
+  if (p == 1.0)
+    return std::numeric_limits<double>::infinity();
+
+  // coefficients of AS 241, in increasing order of the power
+  static constexpr double a[8] = { 3.387132872796366608,
+                                   133.14166789178437745,
+                                   1971.5909503065514427,
+                                   13731.693765509461125,
+                                   45921.953931549871457,
+                                   67265.770927008700853,
+                                   33430.575583588128105,
+                                   2509.0809287301226727 };
+  static constexpr double b[8] = { 1.0,
+                                   42.313330701600911252,
+                                   687.1870074920579083,
+                                   5394.1960214247511077,
+                                   21213.794301586595867,
+                                   39307.89580009271061,
+                                   28729.085735721942674,
+                                   5226.495278852545925 };
+  static constexpr double c[8] = { 1.42343711074968357734,
+                                   4.6303378461565452959,
+                                   5.7694972214606914055,
+                                   3.64784832476320460504,
+                                   1.27045825245236838258,
+                                   0.24178072517745061177,
+                                   0.0227238449892691845833,
+                                   7.7454501427834140764e-4 };
+  static constexpr double d[8] = { 1.0,
+                                   2.05319162663775882187,
+                                   1.6763848301838038494,
+                                   0.68976733498510000455,
+                                   0.14810397642748007459,
+                                   0.0151986665636164571966,
+                                   5.475938084995344946e-4,
+                                   1.05075007164441684324e-9 };
+  static constexpr double e[8] = { 6.6579046435011037772,
+                                   5.4637849111641143699,
+                                   1.7848265399172913358,
+                                   0.29656057182850489123,
+                                   0.026532189526576123093,
+                                   0.0012426609473880784386,
+                                   2.71155556874348757815e-5,
+                                   2.01033439929228813265e-7 };
+  static constexpr double f[8] = { 1.0,
+                                   0.59983220655588793769,
+                                   0.13692988092273580531,
+                                   0.0148753612908506148525,
+                                   7.868691311456132591e-4,
+                                   1.8463183175100546818e-5,
+                                   1.4215117583164458887e-7,
+                                   2.04426310338993978564e-15 };
+  auto ratio = [](const double* num, const double* den, double r) {
+    double u = num[7], v = den[7];
+    for (int k = 6; k >= 0; --k) {
+      u = u * r + num[k];
+      v = v * r + den[k];
+    }
+    return u / v;
+  };
+
+  double q = p - 0.5;
+  double x;
+  if (std::fabs(q) <= 0.425) {
+    x = q * ratio(a, b, 0.180625 - q * q);
+  } else {
+    double r = std::sqrt(-std::log(q < 0.0 ? p : 1.0 - p));
+    x = (r <= 5.0) ? ratio(c, d, r - 1.6) : ratio(e, f, r - 5.0);
+    if (q < 0.0)
+      x = -x;
+  }
+  return x;
+}
+
+} // end namespace detail
+
 //! standard normal density
 //! @param x evaluation points.
 //! @return matrix of pdf values.
 inline Eigen::MatrixXd
 dnorm(const Eigen::MatrixXd& x)
 {
-  boost::math::normal dist;
-  return x.unaryExpr(
-    [&dist](const double& y) { return boost::math::pdf(dist, y); });
+  return (-0.5 * x.array().square()).exp() * detail::inv_sqrt_2pi;
 }
 
-//! standard normal density
+//! derivatives of the standard normal density
 //! @param x evaluation points.
 //! @param drv order of the derivative
 //! @return matrix of pdf values.
 inline Eigen::MatrixXd
 dnorm_drv(const Eigen::MatrixXd& x, unsigned drv)
 {
-  boost::math::normal dist;
-  double rt2 = std::sqrt(2);
-  return x.unaryExpr([&dist, &drv, &rt2](const double& y) {
-    double res = boost::math::pdf(dist, y);
-    // boost implementes phsyicist's hermite poly; rescale to probabilist's.
-    res *= boost::math::hermite(drv, y / rt2);
-    res *= std::pow(0.5, drv * 0.5);
-    if (drv % 2)
-      res = -res;
-    return res;
-  });
+  // phi^(k + 1)(x) = -x phi^(k)(x) - k phi^(k - 1)(x), see dnorm_drvs()
+  Eigen::ArrayXXd f0 = dnorm(x);
+  if (drv == 0)
+    return f0;
+  Eigen::ArrayXXd f1 = -x.array() * f0;
+  for (unsigned k = 1; k < drv; ++k) {
+    f0 = -x.array() * f1 - static_cast<double>(k) * f0;
+    f0.swap(f1);
+  }
+  return f1;
+}
+
+//! all derivatives of the standard normal density up to a given order
+//!
+//! The derivatives are \f$ \phi^{(k)}(x) = (-1)^k He_k(x) \phi(x) \f$,
+//! where \f$ He_k \f$ are the probabilists' Hermite polynomials. They are
+//! computed in one pass from the three-term recurrence
+//! \f$ \phi^{(k + 1)}(x) = -x \phi^{(k)}(x) - k \phi^{(k - 1)}(x) \f$.
+//! @param x evaluation points.
+//! @param max_drv highest order of the derivative.
+//! @return matrix with `max_drv + 1` columns; column `k` contains the `k`-th
+//!   derivative evaluated at `x`.
+inline Eigen::MatrixXd
+dnorm_drvs(const Eigen::VectorXd& x, unsigned max_drv)
+{
+  Eigen::MatrixXd res(x.size(), max_drv + 1);
+  res.col(0) = dnorm(x);
+  if (max_drv > 0)
+    res.col(1) = -x.cwiseProduct(res.col(0));
+  for (unsigned k = 1; k < max_drv; ++k) {
+    res.col(k + 1) = -x.cwiseProduct(res.col(k)) -
+                     static_cast<double>(k) * res.col(k - 1);
+  }
+  return res;
+}
+
+//! Gaussian kernel truncated at +/- 5
+//!
+//! The kernel is renormalized to integrate to one over its support and can be
+//! used for exact (non-binned) evaluation of kernel density estimates.
+//! @param x evaluation points.
+//! @return matrix of kernel values.
+inline Eigen::MatrixXd
+kern_gauss(const Eigen::MatrixXd& x)
+{
+  // 1 / (2 * pnorm(5) - 1)
+  constexpr double norm_const = 1.0000005733034725;
+  return (x.array().abs() > 5.0).select(0.0, dnorm(x).array() * norm_const);
 }
 
 //! standard normal cdf
@@ -51,9 +185,8 @@ dnorm_drv(const Eigen::MatrixXd& x, unsigned drv)
 inline Eigen::MatrixXd
 pnorm(const Eigen::MatrixXd& x)
 {
-  boost::math::normal dist;
   return x.unaryExpr(
-    [&dist](const double& y) { return boost::math::cdf(dist, y); });
+    [](const double& y) { return 0.5 * std::erfc(-y / detail::sqrt2); });
 }
 
 //! standard normal quantiles
@@ -62,9 +195,7 @@ pnorm(const Eigen::MatrixXd& x)
 inline Eigen::MatrixXd
 qnorm(const Eigen::MatrixXd& x)
 {
-  boost::math::normal dist;
-  return x.unaryExpr(
-    [&dist](const double& y) { return boost::math::quantile(dist, y); });
+  return x.unaryExpr([](const double& y) { return detail::qnorm1(y); });
 }
 
 //! empirical quantiles
@@ -130,7 +261,7 @@ quantile(const Eigen::VectorXd& x,
   double wsum = w.sum() - w(ind[n - 1]);
   for (size_t j = 0; j < m; ++j) {
     size_t i = 1;
-    while ((wcum(i) < q(j) * wsum) & (i < n))
+    while ((i < n) && (wcum(i) < q(j) * wsum))
       i++;
     res(j) = x2(i - 1);
     if (w(ind[i - 1]) > 1e-30) {
@@ -142,57 +273,302 @@ quantile(const Eigen::VectorXd& x,
   return res;
 }
 
+namespace detail {
+
+//! The levels (distinct non-NaN values) of a vector in ascending order and
+//! their counts.
+//!
+//! Integers with a range of less than `max_dense_range` are counted in a
+//! table indexed by value, other data in a hash table. Both take linear time
+//! and do not sort the data.
+class LevelTable
+{
+public:
+  explicit LevelTable(const Eigen::VectorXd& x);
+
+  Eigen::Index find(double x) const;
+  const Eigen::VectorXd& get_levels() const { return levels_; }
+  const Eigen::Matrix<Eigen::Index, Eigen::Dynamic, 1>& get_counts() const
+  {
+    return counts_;
+  }
+
+private:
+  static constexpr double max_dense_range{ 65536 };
+  double offset_{ NAN };
+  std::vector<Eigen::Index> dense_index_;
+  Eigen::VectorXd levels_;
+  Eigen::Matrix<Eigen::Index, Eigen::Dynamic, 1> counts_;
+};
+
+inline LevelTable::LevelTable(const Eigen::VectorXd& x)
+{
+  double lb = std::numeric_limits<double>::infinity(), ub = -lb;
+  bool integer = true;
+  for (Eigen::Index i = 0; i < x.size(); ++i) {
+    if (std::isnan(x(i)))
+      continue;
+    lb = std::min(lb, x(i));
+    ub = std::max(ub, x(i));
+    integer = integer && (x(i) == std::round(x(i)));
+  }
+  if (!(lb <= ub))
+    return;
+
+  if (integer && (ub - lb < max_dense_range)) {
+    offset_ = lb;
+    auto range = static_cast<size_t>(ub - lb) + 1;
+    std::vector<Eigen::Index> slot_counts(range, 0);
+    for (Eigen::Index i = 0; i < x.size(); ++i) {
+      if (!std::isnan(x(i)))
+        ++slot_counts[static_cast<size_t>(x(i) - lb)];
+    }
+    auto nlevels = std::count_if(slot_counts.begin(),
+                                 slot_counts.end(),
+                                 [](Eigen::Index c) { return c > 0; });
+    levels_.resize(nlevels);
+    counts_.resize(nlevels);
+    dense_index_.assign(range, -1);
+    Eigen::Index l = 0;
+    for (size_t k = 0; k < range; ++k) {
+      if (slot_counts[k] == 0)
+        continue;
+      dense_index_[k] = l;
+      levels_(l) = lb + static_cast<double>(k);
+      counts_(l++) = slot_counts[k];
+    }
+  } else {
+    std::unordered_map<double, Eigen::Index> table;
+    for (Eigen::Index i = 0; i < x.size(); ++i) {
+      if (!std::isnan(x(i)))
+        ++table[x(i)];
+    }
+    std::vector<std::pair<double, Eigen::Index>> sorted(table.begin(),
+                                                        table.end());
+    std::sort(sorted.begin(), sorted.end());
+    auto nlevels = static_cast<Eigen::Index>(sorted.size());
+    levels_.resize(nlevels);
+    counts_.resize(nlevels);
+    for (Eigen::Index l = 0; l < nlevels; ++l) {
+      levels_(l) = sorted[static_cast<size_t>(l)].first;
+      counts_(l) = sorted[static_cast<size_t>(l)].second;
+    }
+  }
+}
+
+//! the index of the level of a (non-NaN) value of the vector.
+inline Eigen::Index
+LevelTable::find(double x) const
+{
+  if (!dense_index_.empty())
+    return dense_index_[static_cast<size_t>(x - offset_)];
+  return std::lower_bound(levels_.data(), levels_.data() + levels_.size(), x) -
+         levels_.data();
+}
+
+} // end kde1d::stats::detail
+
 // conditionally equidistant jittering; equivalent to the R implementation:
 //   tab <- table(x)
 //   noise <- unname(unlist(lapply(tab, function(l) -0.5 + 1:l / (l + 1))))
 //   s <- sort(x, index.return = TRUE)
 //   return((s$x + noise)[rank(x, ties.method = "first", na.last = "keep")])
+// The ranks within a level are counted in a second pass over the data, so x
+// is never sorted.
 inline Eigen::VectorXd
 equi_jitter(const Eigen::VectorXd& x)
 {
-  size_t n = x.size();
+  detail::LevelTable table(x);
+  const auto& counts = table.get_counts();
+  Eigen::Matrix<Eigen::Index, Eigen::Dynamic, 1> ranks =
+    Eigen::Matrix<Eigen::Index, Eigen::Dynamic, 1>::Zero(counts.size());
 
-  // first compute the corresponding permutation that sorts x (required later)
-  auto perm = tools::get_order(x);
-  // actually sort x
-  Eigen::VectorXd srt(n);
-  for (size_t i = 0; i < n; ++i)
-    srt(i) = x(perm(i));
-
-  // compute contingency table
-  Eigen::MatrixXd tab(n, 2);
-  size_t lev = 0;
-  double cnt = 1;
-  for (size_t k = 1; k < n; ++k) {
-    if (srt(k - 1) != srt(k)) {
-      tab(lev, 0) = srt(k - 1);
-      tab(lev++, 1) = cnt;
-      cnt = 1;
-    } else {
-      cnt++;
-      if (k == n - 1) {
-        tab(lev, 0) = srt(k);
-        tab(lev++, 1) = cnt;
-      }
-    }
+  // add deterministic, conditionally uniform noise
+  Eigen::VectorXd jtr = x;
+  for (Eigen::Index i = 0; i < x.size(); ++i) {
+    if (std::isnan(x(i)))
+      continue;
+    Eigen::Index l = table.find(x(i));
+    auto cnt = static_cast<double>(counts(l));
+    jtr(i) += -0.5 + static_cast<double>(++ranks(l)) / (cnt + 1.0);
   }
-  tab.conservativeResize(lev, 2);
 
-  // add deterministic, conditionally uniform noise
-  Eigen::VectorXd noise = Eigen::VectorXd::Zero(n);
-  size_t i = 0;
-  for (long k = 0; k < tab.rows(); ++k) {
-    for (cnt = 1; cnt <= tab(k, 1); ++cnt)
-      noise(i++) = -0.5 + cnt / (tab(k, 1) + 1.0);
-    cnt = 1;
+  return jtr;
+}
+
+//! The jittered sample `equi_jitter(x)`, represented by the levels of `x` and
+//! their counts.
+//!
+//! The jittered values of a level \f$ k \f$ with count \f$ c \f$ are
+//! \f$ k - 1/2 + r / (c + 1) \f$ for \f$ r = 1, \dots, c \f$. Moments and
+//! linear bin counts of the jittered sample therefore follow from the table
+//! of levels, without materializing (or sorting) the jittered sample. Order
+//! statistics (`min()`, `max()`, `quantile()`) additionally require that the
+//! levels are at least one apart (see `is_ordered()`), as for integer data.
+class JitteredLevels
+{
+public:
+  explicit JitteredLevels(const Eigen::VectorXd& x);
+
+  Eigen::Index size() const { return n_; }
+  bool is_ordered() const;
+  double min() const { return order_statistic(0); }
+  double max() const { return order_statistic(n_ - 1); }
+  double mean() const;
+  double sd() const;
+  Eigen::VectorXd quantile(const Eigen::VectorXd& q) const;
+  Eigen::VectorXd linbin(double lower, double upper, size_t num_bins) const;
+  Eigen::VectorXd expand() const;
+
+private:
+  double value(Eigen::Index l, Eigen::Index r) const;
+  double order_statistic(Eigen::Index j) const;
+
+  Eigen::VectorXd levels_;
+  Eigen::Matrix<Eigen::Index, Eigen::Dynamic, 1> counts_;
+  Eigen::Matrix<Eigen::Index, Eigen::Dynamic, 1> cum_counts_;
+  Eigen::Index n_;
+};
+
+//! @param x the (unjittered) data; NaNs are ignored.
+inline JitteredLevels::JitteredLevels(const Eigen::VectorXd& x)
+{
+  detail::LevelTable table(x);
+  levels_ = table.get_levels();
+  counts_ = table.get_counts();
+  cum_counts_.resize(counts_.size() + 1);
+  cum_counts_(0) = 0;
+  for (Eigen::Index l = 0; l < counts_.size(); ++l)
+    cum_counts_(l + 1) = cum_counts_(l) + counts_(l);
+  n_ = cum_counts_(counts_.size());
+}
+
+//! whether the jittered values of each level are smaller than those of the
+//! next level.
+inline bool
+JitteredLevels::is_ordered() const
+{
+  Eigen::Index nlevels = levels_.size();
+  if (nlevels < 2)
+    return true;
+  return (levels_.tail(nlevels - 1) - levels_.head(nlevels - 1)).minCoeff() >=
+         1.0;
+}
+
+//! the `r`-th (1-based) jittered value of level `l` (computed exactly as in
+//! `equi_jitter()`).
+inline double
+JitteredLevels::value(Eigen::Index l, Eigen::Index r) const
+{
+  auto cnt = static_cast<double>(counts_(l));
+  return levels_(l) + (-0.5 + static_cast<double>(r) / (cnt + 1.0));
+}
+
+//! the `j`-th (0-based) smallest jittered value.
+inline double
+JitteredLevels::order_statistic(Eigen::Index j) const
+{
+  const Eigen::Index* cum = cum_counts_.data();
+  Eigen::Index l = std::upper_bound(cum, cum + cum_counts_.size(), j) - cum - 1;
+  return value(l, j - cum_counts_(l) + 1);
+}
+
+//! the mean (the noise of each level sums to zero).
+inline double
+JitteredLevels::mean() const
+{
+  return levels_.dot(counts_.cast<double>()) / static_cast<double>(n_);
+}
+
+//! the standard deviation; the noise of a level with count \f$ c \f$
+//! contributes \f$ c (c - 1) / (12 (c + 1)) \f$ to the sum of squares.
+inline double
+JitteredLevels::sd() const
+{
+  Eigen::ArrayXd cnt = counts_.cast<double>().array();
+  double ss = (cnt * (levels_.array() - mean()).square()).sum() +
+              (cnt * (cnt - 1) / (12 * (cnt + 1))).sum();
+  return std::sqrt(ss / (static_cast<double>(n_) - 1));
+}
+
+//! empirical quantiles (type 7, as `stats::quantile()`).
+//! @param q evaluation points.
+inline Eigen::VectorXd
+JitteredLevels::quantile(const Eigen::VectorXd& q) const
+{
+  double n = static_cast<double>(n_ - 1);
+  Eigen::VectorXd res(q.size());
+  for (Eigen::Index i = 0; i < q.size(); ++i) {
+    auto k = static_cast<Eigen::Index>(std::floor(n * q(i)));
+    double p = static_cast<double>(k) / n;
+    res(i) = order_statistic(k);
+    if (static_cast<double>(k) < n)
+      res(i) += (order_statistic(k + 1) - res(i)) * (q(i) - p) * n;
   }
-  Eigen::VectorXd jtr = srt + noise;
+  return res;
+}
+
+//! linear bin counts of the jittered sample (see `tools::linbin()`).
+//!
+//! The values of a level are equally spaced, so those falling into the same
+//! bin form a run whose binning weights are sums of an arithmetic
+//! progression. The runs are found from the spacing (and verified with the
+//! exact positions), which takes O(1) per level and bin.
+inline Eigen::VectorXd
+JitteredLevels::linbin(double lower, double upper, size_t num_bins) const
+{
+  Eigen::VectorXd gcnts = Eigen::VectorXd::Zero(num_bins + 1);
+  double delta = (upper - lower) / static_cast<double>(num_bins);
+  auto max_bin = static_cast<double>(num_bins);
+  for (Eigen::Index l = 0; l < levels_.size(); ++l) {
+    Eigen::Index c = counts_(l);
+    auto pos = [&](Eigen::Index r) { return (value(l, r) - lower) / delta; };
+    double step = 1.0 / (static_cast<double>(c) + 1.0) / delta;
+    auto steps = [step](double dist) {
+      return static_cast<Eigen::Index>(std::min(dist / step, 1e18));
+    };
+
+    // skip the values ignored by tools::linbin()
+    Eigen::Index r = 1;
+    if (pos(r) <= -1) {
+      r = std::min(r + steps(-1 - pos(r)), c);
+      while ((r > 1) && (pos(r - 1) > -1))
+        --r;
+      while ((r <= c) && (pos(r) <= -1))
+        ++r;
+    }
 
-  // invert the permutation to return jittered x in original order
-  for (i = 0; i < static_cast<size_t>(perm.size()); ++i)
-    srt(perm(i)) = jtr(i);
+    // process the runs of values in the same bin (values less than one bin
+    // below the grid are extrapolated from the first bin)
+    while ((r <= c) && (pos(r) < max_bin)) {
+      double lxi = pos(r), bin = std::max(std::floor(lxi), 0.0);
+      Eigen::Index end = std::min(r + steps(bin + 1 - lxi), c);
+      while ((end < c) && (pos(end + 1) < bin + 1))
+        ++end;
+      while (pos(end) >= bin + 1)
+        --end;
+      auto len = static_cast<double>(end - r + 1);
+      double rem = len * ((lxi + pos(end)) / 2 - bin);
+      auto j = static_cast<Eigen::Index>(bin);
+      gcnts(j) += len - rem;
+      gcnts(j + 1) += rem;
+      r = end + 1;
+    }
+  }
 
-  return srt;
+  return gcnts;
+}
+
+//! the jittered sample in ascending order.
+inline Eigen::VectorXd
+JitteredLevels::expand() const
+{
+  Eigen::VectorXd x(n_);
+  for (Eigen::Index l = 0; l < levels_.size(); ++l) {
+    for (Eigen::Index r = 1; r <= counts_(l); ++r)
+      x(cum_counts_(l) + r - 1) = value(l, r);
+  }
+  return x;
 }
 
 //! @brief simulates from the standard uniform distribution.
@@ -225,6 +601,133 @@ simulate_uniform(size_t n, std::vector<int> seeds)
   return U.unaryExpr([&](double) { return distribution(generator); });
 }
 
+namespace detail {
+
+//! the Philox4x32-10 counter-based generator (Salmon et al., 2011, "Parallel
+//! random numbers: as easy as 1, 2, 3"): a bijection of a 128-bit counter,
+//! keyed with 64 bits, that passes BigCrush for consecutive counters.
+inline std::array<uint32_t, 4>
+philox4x32(std::array<uint32_t, 4> ctr, std::array<uint32_t, 2> key)
+{
+  const uint64_t m0 = 0xD2511F53, m1 = 0xCD9E8D57;
+  for (int round = 0; round < 10; ++round) {
+    uint64_t p0 = m0 * ctr[0], p1 = m1 * ctr[2];
+    ctr = { static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0],
+            static_cast<uint32_t>(p1),
+            static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1],
+            static_cast<uint32_t>(p0) };
+    key[0] += 0x9E3779B9;
+    key[1] += 0xBB67AE85;
+  }
+  return ctr;
+}
+
+//! reverses the order of the bits of a 32-bit integer.
+inline uint32_t
+reverse_bits(uint32_t x)
+{
+  x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+  x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+  x = ((x >> 4) & 0x0F0F0F0F) | ((x & 0x0F0F0F0F) << 4);
+  x = ((x >> 8) & 0x00FF00FF) | ((x & 0x00FF00FF) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+//! a hash in which each bit only depends on itself and lower bits; applied
+//! to bit-reversed numbers, it is a nested uniform (Owen) scramble (Burley,
+//! 2020, "Practical hash-based Owen scrambling").
+inline uint32_t
+laine_karras_permutation(uint32_t x, uint32_t seed)
+{
+  x += seed;
+  x ^= x * 0x6c50b47c;
+  x ^= x * 0xb82f1e52;
+  x ^= x * 0xc7afe638;
+  x ^= x * 0x8d22f6e6;
+  return x;
+}
+
+//! maps 64 random bits to a double in (0, 1) (53 bits of precision).
+inline double
+bits_to_uniform(uint64_t bits)
+{
+  return (static_cast<double>(bits >> 11) + 0.5) * 0x1.0p-53;
+}
+
+} // end kde1d::stats::detail
+
+//! @brief simulates from the standard uniform distribution with a
+//! counter-based random number generator (Philox4x32-10).
+//!
+//! The `i`-th draw of the stream depends only on `seed` and `i`, so a stream
+//! can be generated in chunks or in parallel with identical results (unlike
+//! `simulate_uniform()`, which draws sequentially from a single engine).
+//!
+//! @param u the output vector; its size determines the number of draws.
+//! @param seed the seed of the stream.
+//! @param offset the index of the first draw in the stream.
+inline void
+simulate_uniform_philox(Eigen::Ref<Eigen::VectorXd> u,
+                        uint64_t seed,
+                        uint64_t offset = 0)
+{
+  std::array<uint32_t, 2> key = { static_cast<uint32_t>(seed),
+                                  static_cast<uint32_t>(seed >> 32) };
+  // each counter yields two draws
+  for (Eigen::Index i = 0; i < u.size();) {
+    uint64_t draw = offset + static_cast<uint64_t>(i), block = draw / 2;
+    auto bits = detail::philox4x32({ static_cast<uint32_t>(block),
+                                     static_cast<uint32_t>(block >> 32),
+                                     0,
+                                     0 },
+                                   key);
+    for (uint64_t k = draw % 2; (k < 2) && (i < u.size()); ++k, ++i) {
+      uint64_t x = (static_cast<uint64_t>(bits[2 * k]) << 32) | bits[2 * k + 1];
+      u(i) = detail::bits_to_uniform(x);
+    }
+  }
+}
+
+//! @brief generates the (optionally scrambled) Sobol sequence in one
+//! dimension.
+//!
+//! The first \f$ 2^m \f$ points of the sequence (and every subsequent block
+//! of \f$ 2^m \f$ points) place exactly one point into each of the
+//! intervals \f$ [k 2^{-m}, (k + 1) 2^{-m}) \f$, so averages over the
+//! sequence converge much faster than over random draws; sample sizes and
+//! offsets should be powers of two for best results. Without scrambling,
+//! the sequence is deterministic and the mean over a block is slightly
+//! biased; nested uniform scrambling makes each point uniformly distributed
+//! while preserving the stratification.
+//!
+//! @param u the output vector; its size determines the number of points.
+//! @param scramble whether the sequence should be scrambled.
+//! @param seed the seed of the scrambling (ignored if `scramble = false`).
+//! @param offset the index of the first point in the sequence.
+inline void
+simulate_uniform_sobol(Eigen::Ref<Eigen::VectorXd> u,
+                       bool scramble,
+                       uint64_t seed = 0,
+                       uint64_t offset = 0)
+{
+  const uint64_t max_points = uint64_t(1) << 32;
+  if ((offset > max_points) ||
+      (static_cast<uint64_t>(u.size()) > max_points - offset))
+    throw std::invalid_argument("the Sobol sequence has at most 2^32 points.");
+
+  // the seed is hashed so that similar seeds give unrelated scrambles
+  std::array<uint32_t, 2> key = { static_cast<uint32_t>(seed),
+                                  static_cast<uint32_t>(seed >> 32) };
+  uint32_t scramble_seed = detail::philox4x32({ 0, 0, 0, 0 }, key)[0];
+  for (Eigen::Index i = 0; i < u.size(); ++i) {
+    // in one dimension, the i-th Sobol point has the bits of i in reverse
+    auto index = static_cast<uint32_t>(offset + static_cast<uint64_t>(i));
+    if (scramble)
+      index = detail::laine_karras_permutation(index, scramble_seed);
+    u(i) = (static_cast<double>(detail::reverse_bits(index)) + 0.5) * 0x1.0p-32;
+  }
+}
+
 } // end kde1d::stats
 
 } // end kde1d
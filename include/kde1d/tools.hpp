@@ -53,6 +53,7 @@ invert_f(const Eigen::VectorXd& x,
 }
 
 //! remove rows of a matrix which contain nan values or have zero weight
+//! (preserving the order of the remaining rows).
 //! @param x the matrix.
 //! @param a vector of weights that is either empty or whose size is equal to
 //!   the number of columns of x.
@@ -62,44 +63,50 @@ remove_nans(Eigen::VectorXd& x, Eigen::VectorXd& weights)
   if ((weights.size() > 0) && (weights.size() != x.rows()))
     throw std::runtime_error("sizes of x and weights don't match.");
 
-  // if an entry is nan or weight is zero, move it to the end
-  size_t last = x.size() - 1;
-  for (size_t i = 0; i < last + 1; i++) {
+  // move all valid rows to the front
+  Eigen::Index last = 0;
+  for (Eigen::Index i = 0; i < x.size(); ++i) {
     bool is_nan = std::isnan(x(i));
     if (weights.size() > 0) {
       is_nan = is_nan | std::isnan(weights(i));
       is_nan = is_nan | (weights(i) == 0.0);
     }
-    if (is_nan) {
+    if (!is_nan) {
       if (weights.size() > 0)
-        std::swap(weights(i), weights(last));
-      std::swap(x(i--), x(last--));
+        weights(last) = weights(i);
+      x(last++) = x(i);
     }
   }
 
   // remove nan rows
-  x.conservativeResize(last + 1);
+  x.conservativeResize(last);
   if (weights.size() > 0)
-    weights.conservativeResize(last + 1);
+    weights.conservativeResize(last);
 }
 
-inline Eigen::VectorXi
-get_order(const Eigen::VectorXd& x)
+//! checks whether the non-missing entries of a vector are in ascending
+//! order (in linear time).
+inline bool
+is_sorted(const Eigen::VectorXd& x)
 {
-  Eigen::VectorXi order(x.size());
-  for (long i = 0; i < x.size(); ++i)
-    order(i) = static_cast<int>(i);
-  std::stable_sort(order.data(),
-                   order.data() + order.size(),
-                   [&](const size_t& a, const size_t& b) {
-                     return std::isnan(x[a]) || (x[a] < x[b]);
-                   });
-  return order;
+  double last = -std::numeric_limits<double>::infinity();
+  for (Eigen::Index i = 0; i < x.size(); ++i) {
+    if (std::isnan(x(i)))
+      continue;
+    if (x(i) < last)
+      return false;
+    last = x(i);
+  }
+  return true;
 }
 
 //! Computes bin counts for univariate data via the linear binning strategy.
+//! Observations less than one bin width below `lower` (e.g., due to rounding
+//! in boundary transformations) are extrapolated from the first bin, those
+//! further outside of [lower, upper) are ignored.
 //! @param x vector of observations
-//! @param weights vector of weights for each observation.
+//! @param weights vector of weights for each observation; if empty, all
+//!   observations have unit weight.
 inline Eigen::VectorXd
 linbin(const Eigen::VectorXd& x,
        double lower,
@@ -109,16 +116,17 @@ linbin(const Eigen::VectorXd& x,
 {
   Eigen::VectorXd gcnts = Eigen::VectorXd::Zero(num_bins + 1);
   double delta = (upper - lower) / static_cast<double>(num_bins);
-  double rem, lxi;
-  size_t li;
-  for (long i = 0; i < x.size(); ++i) {
+  double rem, lxi, wi;
+  Eigen::Index li, max_bin = static_cast<Eigen::Index>(num_bins);
+  for (Eigen::Index i = 0; i < x.size(); ++i) {
     lxi = (x(i) - lower) / delta;
-    li = static_cast<size_t>(lxi);
+    if (!((lxi > -1) && (lxi < static_cast<double>(max_bin))))
+      continue;
+    li = static_cast<Eigen::Index>(lxi);
     rem = lxi - static_cast<double>(li);
-    if (li < num_bins) {
-      gcnts(li) += (1 - rem) * weights(i);
-      gcnts(li + 1) += rem * weights(i);
-    }
+    wi = (weights.size() > 0) ? weights(i) : 1.0;
+    gcnts(li) += (1 - rem) * wi;
+    gcnts(li + 1) += rem * wi;
   }
 
   return gcnts;
@@ -2,6 +2,8 @@
 
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
+#include <boost/math/distributions/normal.hpp>
+#include <boost/math/special_functions/hermite.hpp>
 
 using namespace kde1d;
 
@@ -21,6 +23,27 @@ Eigen::VectorXd x_lb = x_rb * (-1.0);
 size_t nlevels = 50;
 Eigen::VectorXd x_d =
   (x_cb.array() * (static_cast<double>(nlevels) - 1)).round();
+// zero-inflated data
+Eigen::VectorXd x_zi = [] {
+  Eigen::VectorXd x = x_lb;
+  x.head(n_sample / 4).setZero();
+  return x;
+}();
+
+// a data set with the bounds and variable type to fit it with
+struct Sample
+{
+  Eigen::VectorXd x;
+  double xmin;
+  double xmax;
+  std::string type;
+};
+
+// one sample for each boundary and variable type
+std::vector<Sample> samples = {
+  { x_ub, NAN, NAN, "c" }, { x_lb, 0, NAN, "c" }, { x_rb, NAN, 0, "c" },
+  { x_cb, 0, 1, "c" },     { x_d, 0, NAN, "d" },  { x_zi, 0, NAN, "zi" }
+};
 
 TEST_CASE("misc checks", "[input-checks][argument-checks]")
 {
@@ -31,7 +54,7 @@ TEST_CASE("misc checks", "[input-checks][argument-checks]")
     CHECK_THROWS(kde1d::Kde1d(1, 0)); // distribution with xmin > xmax
     CHECK_THROWS(kde1d::Kde1d(NAN, NAN, "c", -1.0, NAN, 0)); // negative mult
     CHECK_THROWS(kde1d::Kde1d(NAN, NAN, "c", 1, -1.0, 0)); // negative bandwidth
-    CHECK_THROWS(kde1d::Kde1d(NAN, NAN, "c", 1, NAN, 3));  // wrong degree
+    CHECK_THROWS(kde1d::Kde1d(NAN, NAN, "c", 1, NAN, 5));  // wrong degree
   }
 
   SECTION("methods fail if not fitted")
@@ -74,6 +97,748 @@ TEST_CASE("misc checks", "[input-checks][argument-checks]")
   }
 }
 
+TEST_CASE("normal distribution functions", "[stats]")
+{
+  boost::math::normal dist;
+  auto rel_err = [](double x, double y) {
+    return (x == y) ? 0.0 : std::fabs(x - y) / std::fabs(y);
+  };
+
+  Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(10001, -37.0, 37.0);
+  Eigen::VectorXd d = stats::dnorm(x), p = stats::pnorm(x);
+  double err_d = 0.0, err_p = 0.0;
+  for (long i = 0; i < x.size(); i++) {
+    err_d = std::max(err_d, rel_err(d(i), boost::math::pdf(dist, x(i))));
+    err_p = std::max(err_p, rel_err(p(i), boost::math::cdf(dist, x(i))));
+  }
+  CHECK(err_d < 1e-15);
+  CHECK(err_p < 2e-15);
+
+  // probabilities in the bulk and down to 1e-300 in the tail
+  Eigen::VectorXd u(10299);
+  u.head(9999) = Eigen::VectorXd::LinSpaced(9999, 1e-4, 1.0 - 1e-4);
+  for (long i = 0; i < 300; i++) {
+    u(9999 + i) = std::pow(10.0, -300.0 + static_cast<double>(i));
+  }
+  Eigen::VectorXd q = stats::qnorm(u);
+  double err_q = 0.0;
+  for (long i = 0; i < u.size(); i++) {
+    double q_boost = boost::math::quantile(dist, u(i));
+    err_q =
+      std::max(err_q, std::fabs(q(i) - q_boost) / (1 + std::fabs(q_boost)));
+  }
+  CHECK(err_q < 2e-15);
+
+  // derivatives, compared to boost's (physicists') Hermite polynomials
+  Eigen::VectorXd x_drv = Eigen::VectorXd::LinSpaced(1001, -10.0, 10.0);
+  Eigen::MatrixXd drvs = stats::dnorm_drvs(x_drv, 10);
+  for (unsigned drv = 0; drv <= 10; drv++) {
+    Eigen::VectorXd expected = x_drv.unaryExpr([drv, &dist](double y) {
+      double res = boost::math::pdf(dist, y) *
+                   boost::math::hermite(drv, y / std::sqrt(2.0)) *
+                   std::pow(0.5, drv * 0.5);
+      return (drv % 2) ? -res : res;
+    });
+    double scale = expected.cwiseAbs().maxCoeff();
+    CHECK((drvs.col(drv) - expected).cwiseAbs().maxCoeff() < 1e-12 * scale);
+    CHECK(stats::dnorm_drv(x_drv, drv).isApprox(drvs.col(drv), 1e-14));
+  }
+
+  // truncated Gaussian kernel integrates to one
+  Eigen::VectorXd x_kern = Eigen::VectorXd::LinSpaced(20001, -6.0, 6.0);
+  Eigen::VectorXd kern = stats::kern_gauss(x_kern);
+  CHECK(kern.sum() * 12.0 / 20000.0 == Approx(1.0).epsilon(1e-6));
+  CHECK((x_kern.array().abs() > 5.0).select(kern, 0.0).maxCoeff() == 0.0);
+  CHECK(kern(10000) > stats::dnorm(Eigen::VectorXd::Zero(1))(0));
+
+  Eigen::VectorXd edge(4);
+  edge << 0.0, 1.0, -0.5, NAN;
+  CHECK(stats::qnorm(edge)(0) == -std::numeric_limits<double>::infinity());
+  CHECK(stats::qnorm(edge)(1) == std::numeric_limits<double>::infinity());
+  CHECK(std::isnan(stats::qnorm(edge)(2)));
+  CHECK(std::isnan(stats::qnorm(edge)(3)));
+}
+
+TEST_CASE("data preparation tools", "[tools]")
+{
+  Eigen::VectorXd x(8), w = Eigen::VectorXd::Ones(8);
+  x << 2.0, NAN, 1.0, 2.0, 3.0, NAN, 2.0, 1.0;
+  w(4) = 0.0;
+
+  // ties are spread equidistantly in their original order, NaNs are kept
+  Eigen::VectorXd jtr = stats::equi_jitter(x), jtr_expected(8);
+  jtr_expected << 1.75, NAN, 5.0 / 6.0, 2.0, 3.0, NAN, 2.25, 7.0 / 6.0;
+  CHECK(std::isnan(jtr(1)));
+  CHECK(std::isnan(jtr(5)));
+  jtr(1) = jtr(5) = jtr_expected(1) = jtr_expected(5) = 0.0;
+  CHECK(jtr.isApprox(jtr_expected));
+
+  // removal keeps the order of the valid rows
+  Eigen::VectorXd x_clean = x, w_clean = w, x_expected(5);
+  tools::remove_nans(x_clean, w_clean);
+  x_expected << 2.0, 1.0, 2.0, 2.0, 1.0;
+  CHECK(x_clean == x_expected);
+  CHECK(w_clean.size() == 5);
+
+  // points outside of the grid are ignored; empty weights are unit weights
+  Eigen::VectorXd z(5);
+  z << -2.0, -0.5, 0.0, 1.0, 0.3;
+  Eigen::VectorXd counts = tools::linbin(z, -1.0, 1.0, 4, Eigen::VectorXd());
+  CHECK(counts.sum() == Approx(3.0));
+  CHECK(counts == tools::linbin(z, -1.0, 1.0, 4, Eigen::VectorXd::Ones(5)));
+
+  // the jittered levels give the same statistics as the jittered data
+  stats::JitteredLevels levels(x_d);
+  Eigen::VectorXd x_jtr = stats::equi_jitter(x_d), q(3);
+  q << 0.1, 0.5, 0.9;
+  CHECK(levels.is_ordered());
+  CHECK(levels.size() == x_d.size());
+  CHECK(levels.min() == x_jtr.minCoeff());
+  CHECK(levels.max() == x_jtr.maxCoeff());
+  CHECK(levels.mean() == Approx(x_jtr.mean()).epsilon(1e-12));
+  CHECK(levels.quantile(q).isApprox(stats::quantile(x_jtr, q), 1e-12));
+  CHECK(levels.linbin(-3.0, 40.0, 401)
+          .isApprox(tools::linbin(x_jtr, -3.0, 40.0, 401, Eigen::VectorXd()),
+                    1e-12));
+  std::sort(x_jtr.data(), x_jtr.data() + x_jtr.size());
+  CHECK(levels.expand() == x_jtr);
+}
+
+TEST_CASE("binned kernel density derivatives", "[fft]")
+{
+  fft::KdeFFT kde_fft(x_ub, 0.3, x_ub.minCoeff(), x_ub.maxCoeff());
+  Eigen::VectorXd f1 = kde_fft.kde_drv(1);
+  Eigen::VectorXd f4 = kde_fft.kde_drv(4);
+  kde_fft.set_bandwidth(0.1);
+  Eigen::VectorXd f0 = kde_fft.kde_drv(0);
+
+  // cached kernel taps must be invalidated when the bandwidth changes
+  fft::KdeFFT kde_fft2(x_ub, 0.1, x_ub.minCoeff(), x_ub.maxCoeff());
+  CHECK(f0.isApprox(kde_fft2.kde_drv(0), 1e-12));
+  kde_fft2.set_bandwidth(0.3);
+  CHECK(f4.isApprox(kde_fft2.kde_drv(4), 1e-12));
+  CHECK(f1.isApprox(kde_fft2.kde_drv(1), 1e-12));
+  CHECK(f0.sum() * kde_fft.get_bin_width() == Approx(1.0).epsilon(0.01));
+
+  SECTION("direct evaluation is exact")
+  {
+    Eigen::VectorXd x = x_ub.head(50);
+    double lower = x.minCoeff() - 1, upper = x.maxCoeff() + 1, h = 0.4;
+    direct::KdeDirect kde_direct(x, h, lower, upper);
+    Eigen::MatrixXd f = kde_direct.kde_drvs(3);
+
+    Eigen::VectorXd grid = Eigen::VectorXd::LinSpaced(401, lower, upper);
+    Eigen::MatrixXd f_exact = Eigen::MatrixXd::Zero(401, 4);
+    for (long i = 0; i < x.size(); i++) {
+      Eigen::VectorXd u = (grid.array() - x(i)) / h;
+      Eigen::VectorXd kern = stats::kern_gauss(u);
+      Eigen::MatrixXd drvs = stats::dnorm_drvs(u, 3);
+      for (long drv = 0; drv < 4; drv++) {
+        double scale = 50.0 * std::pow(h, static_cast<double>(drv) + 1.0);
+        f_exact.col(drv) +=
+          (kern.array() > 0).select(drvs.col(drv), 0.0) / scale;
+      }
+    }
+    f_exact *= stats::kern_gauss(Eigen::VectorXd::Zero(1))(0) /
+               stats::dnorm(Eigen::VectorXd::Zero(1))(0);
+    CHECK(f.isApprox(f_exact, 1e-12));
+    CHECK(kde_direct.kde_drv(2).isApprox(f_exact.col(2), 1e-12));
+
+    // used by small-sample fits
+    kde1d::Kde1d fit(NAN, NAN, "c", 1, h, 0);
+    fit.fit(x);
+    Eigen::VectorXd x_ev = x.head(10);
+    Eigen::VectorXd pdf_exact = Eigen::VectorXd::Zero(10);
+    for (long i = 0; i < x.size(); i++) {
+      Eigen::VectorXd u = (x_ev.array() - x(i)) / h;
+      pdf_exact += stats::kern_gauss(u) / (50.0 * h);
+    }
+    CHECK(fit.pdf(x_ev).isApprox(pdf_exact, 1e-3));
+  }
+
+  SECTION("direct evaluation at arbitrary points")
+  {
+    Eigen::VectorXd x = x_ub.head(500);
+    double lower = x.minCoeff() - 1, upper = x.maxCoeff() + 1, h = 0.3;
+    Eigen::MatrixXd f_grid = direct::KdeDirect(x, h, lower, upper).kde_drvs(2);
+    Eigen::VectorXd grid = Eigen::VectorXd::LinSpaced(401, lower, upper);
+    Eigen::VectorXd x_ev = grid.reverse();
+    x_ev(7) = NAN;
+    Eigen::MatrixXd f_ev = direct::kde_drvs(x_ev, x, h, 2);
+    CHECK(std::isnan(f_ev(7, 0)));
+    f_ev.row(7) = f_grid.row(393);
+    CHECK(f_ev.colwise().reverse().isApprox(f_grid, 1e-10));
+  }
+}
+
+TEST_CASE("local polynomial moment matrix", "[locpoly]")
+{
+  double h = 0.3;
+  fft::KdeFFT kde(x_ub, h, x_ub.minCoeff() - 1, x_ub.maxCoeff() + 1);
+  Eigen::MatrixXd f = kde.kde_drvs(2);
+  Eigen::ArrayXd b = f.col(1).cwiseQuotient(f.col(0));
+  Eigen::ArrayXd D = f.col(2).cwiseQuotient(f.col(0)).array() - b.square();
+  Eigen::VectorXd s = 1 / (h * h * (1 + h * h * D));
+
+  double B = h * h;
+  for (size_t degree = 0; degree < 3; degree++) {
+    Eigen::VectorXd inv00 = locpoly::inverse_moment00(f, h, s, degree);
+    Eigen::VectorXd inv00_ref(f.rows());
+    for (long k = 0; k < f.rows(); k++) {
+      double f0 = f(k, 0), f1 = f(k, 1), f2 = f(k, 2);
+      if (degree == 0) {
+        inv00_ref(k) = 1 / f0;
+      } else if (degree == 1) {
+        Eigen::Matrix2d M;
+        M << f0, B * f1, B * f1, B * f0 + B * B * f1 * f1 / f0;
+        inv00_ref(k) = M.inverse()(0, 0);
+      } else {
+        double s2 = B * f1 / f0, m11 = B * B * f2 + B * f0;
+        double m12 = f0 / 2 * (3 / s(k) * s2 + std::pow(s2, 3));
+        double m22 = f0 / 4 *
+                     (3 / (s(k) * s(k)) + 6 / s(k) * std::pow(s2, 2) +
+                      std::pow(s2, 4));
+        Eigen::Matrix3d M;
+        M << f0, B * f1, m11 / 2, B * f1, m11, m12, m11 / 2, m12, m22;
+        inv00_ref(k) = M.inverse()(0, 0);
+      }
+    }
+    // M is ill-conditioned in the far tails, where neither is accurate
+    auto body = f.col(0).array() > 1e-3;
+    CHECK(body.select(inv00, 0.0).isApprox(body.select(inv00_ref, 0.0), 1e-12));
+  }
+}
+
+TEST_CASE("kernels and higher degrees", "[kernel]")
+{
+  auto points = stats::qnorm(upoints);
+  auto target = stats::dnorm(points);
+
+  SECTION("kernel constants are consistent")
+  {
+    Eigen::VectorXd u = Eigen::VectorXd::LinSpaced(100001, -6, 6);
+    double du = u(1) - u(0);
+    for (auto type : { KernelType::gaussian,
+                       KernelType::epanechnikov,
+                       KernelType::biweight }) {
+      Kernel kernel(type);
+      Eigen::MatrixXd k = kernel.drvs(u, 1);
+      CHECK(k.col(0).sum() * du == Approx(1.0).epsilon(1e-6));
+      CHECK(k.col(0).squaredNorm() * du ==
+            Approx(kernel.roughness()).epsilon(1e-6));
+      CHECK(k.col(0).dot(u.cwiseAbs2()) * du ==
+            Approx(kernel.variance()).epsilon(1e-6));
+      CHECK(kernel.drvs(Eigen::VectorXd::Zero(1), 0)(0) == kernel.at_zero());
+      Eigen::VectorXd k1 = (k.col(0).tail(100000) - k.col(0).head(100000)) / du;
+      k1 -= (k.col(1).tail(100000) + k.col(1).head(100000)) / 2;
+      CHECK(k1.cwiseAbs().sum() * du < 1e-3);
+    }
+  }
+
+  SECTION("estimates are reasonable")
+  {
+    for (auto type : { KernelType::epanechnikov, KernelType::biweight }) {
+      kde1d::Kde1d fit(NAN, NAN, "c", 1, NAN, 0, BandwidthMethod::plugin, type);
+      fit.fit(x_ub);
+      CHECK(fit.get_kernel() == type);
+      CHECK(fit.pdf(points).isApprox(target, pdf_tol));
+      CHECK(fit.pdf(points).isApprox(fit.pdf_exact(points, x_ub), 1e-3));
+
+      // small samples use direct evaluation
+      Eigen::VectorXd x = x_ub.head(50);
+      kde1d::Kde1d fit_small(
+        NAN, NAN, "c", 1, NAN, 0, BandwidthMethod::sj, type);
+      fit_small.fit(x);
+      Eigen::VectorXd pdf_exact = fit_small.pdf_exact(points, x);
+      CHECK(fit_small.pdf(points).isApprox(pdf_exact, 1e-3));
+
+      // bandwidths are transferred from the Gaussian kernel
+      kde1d::Kde1d fit_gauss(NAN, NAN, "c", 1, NAN, 0, BandwidthMethod::sj);
+      fit_gauss.fit(x);
+      double ratio = Kernel(type).canonical_bandwidth() /
+                     Kernel().canonical_bandwidth();
+      CHECK(fit_small.get_bandwidth() ==
+            Approx(fit_gauss.get_bandwidth() * ratio));
+
+      CHECK_THROWS(
+        kde1d::Kde1d(NAN, NAN, "c", 1, NAN, 1, BandwidthMethod::plugin, type));
+    }
+
+    for (size_t degree = 3; degree < 5; degree++) {
+      kde1d::Kde1d fit(NAN, NAN, "c", 1, NAN, degree);
+      fit.fit(x_ub);
+      CHECK(fit.pdf(points).isApprox(target, pdf_tol));
+      CHECK(fit.pdf(points).isApprox(fit.pdf_exact(points, x_ub), 1e-3));
+      CHECK(fit.get_edf() > 0);
+    }
+  }
+}
+
+TEST_CASE("tiny samples", "[tiny]")
+{
+  for (long int n = 1; n < 4; n++) {
+    for (size_t degree = 0; degree < 5; degree++) {
+      for (auto& sample : { samples[0], samples[1] }) {
+        Eigen::VectorXd x = sample.x.head(n);
+        kde1d::Kde1d fit(sample.xmin, sample.xmax, "c", 1, NAN, degree);
+        fit.fit(x);
+        Eigen::VectorXd pdf = fit.pdf(x);
+        CHECK(pdf.allFinite());
+        CHECK(pdf.minCoeff() > 0);
+        CHECK(std::isfinite(fit.get_loglik()));
+        Eigen::VectorXd p = fit.cdf(Eigen::VectorXd::Constant(1, 1e3));
+        CHECK(p(0) > 0.95);
+        CHECK(p(0) <= 1.0);
+        if (n == 1) {
+          // the local polynomial degenerates for a single observation, exact
+          // evaluation must fall back to the local constant fit as well
+          CHECK(pdf.isApprox(fit.pdf_exact(x, x), 1e-2));
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("leave-one-out densities", "[loo]")
+{
+  size_t n = 300;
+  Eigen::VectorXd x = x_ub.head(n);
+  for (size_t degree = 0; degree < 3; degree++) {
+    kde1d::Kde1d fit(NAN, NAN, "c", 1, NAN, degree);
+    fit.fit(x);
+    Eigen::VectorXd loo = fit.loo_pdf(x);
+    for (size_t i = 0; i < 5; i++) {
+      Eigen::VectorXd x_minus(n - 1);
+      x_minus << x.head(i), x.tail(n - 1 - i);
+      kde1d::Kde1d fit_minus(NAN, NAN, "c", 1, fit.get_bandwidth(), degree);
+      fit_minus.fit(x_minus);
+      CHECK(loo(i) == Approx(fit_minus.pdf(x.segment(i, 1))(0)).epsilon(0.01));
+    }
+    CHECK(fit.loo_loglik(x) < fit.get_loglik());
+  }
+
+  // isolated observations near the boundary are influential
+  Eigen::VectorXd x_exp = -stats::simulate_uniform(500, { 3 }).array().log();
+  std::vector<Eigen::Index> order(500);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](Eigen::Index a, Eigen::Index b) {
+    return x_exp(a) < x_exp(b);
+  });
+  for (size_t degree = 0; degree < 3; degree++) {
+    kde1d::Kde1d fit(0, NAN, "c", 1, NAN, degree);
+    fit.fit(x_exp);
+    Eigen::VectorXd loo = fit.loo_pdf(x_exp);
+    for (size_t k = 0; k < 10; k++) {
+      auto i = order[k];
+      Eigen::VectorXd x_minus(499);
+      x_minus << x_exp.head(i), x_exp.tail(499 - i);
+      kde1d::Kde1d fit_minus(0, NAN, "c", 1, fit.get_bandwidth(), degree);
+      fit_minus.fit(x_minus);
+      CHECK(loo(i) ==
+            Approx(fit_minus.pdf(x_exp.segment(i, 1))(0)).epsilon(0.05));
+    }
+    CHECK(std::isfinite(fit.loo_loglik(x_exp)));
+  }
+
+  Eigen::VectorXd zi = x_lb.head(n);
+  zi.head(n / 4).setZero();
+  kde1d::Kde1d fit_zi(0, NAN, "zi");
+  fit_zi.fit(zi);
+  double n0 = static_cast<double>(n / 4);
+  CHECK(fit_zi.loo_pdf(zi)(0) ==
+        Approx((n0 - 1) / (static_cast<double>(n) - 1)));
+
+  kde1d::Kde1d fit_one;
+  fit_one.fit(x.head(1));
+  CHECK_THROWS(fit_one.loo_pdf(x.head(1)));
+}
+
+TEST_CASE("exact pdf evaluation", "[exact]")
+{
+  for (const auto& sample : samples) {
+    kde1d::Kde1d fit(sample.xmin, sample.xmax, sample.type);
+    fit.fit(sample.x);
+    Eigen::VectorXd x_ev = sample.x.tail(100);
+    CHECK(fit.pdf_exact(x_ev, sample.x).isApprox(fit.pdf(x_ev), 0.02));
+  }
+
+  kde1d::Kde1d fit_grid(kde1d::interp::InterpolationGrid(
+    ugrid, Eigen::VectorXd::Ones(ugrid.size()), 3));
+  CHECK_THROWS(fit_grid.pdf_exact(upoints, x_cb));
+}
+
+TEST_CASE("fused pdf and cdf evaluation", "[pdf_cdf]")
+{
+  for (const auto& sample : samples) {
+    kde1d::Kde1d fit(sample.xmin, sample.xmax, sample.type);
+    fit.fit(sample.x);
+
+    // unsorted, outside the grid, non-integer, and zero
+    Eigen::VectorXd x_ev(105);
+    x_ev << sample.x.tail(100), -100, 100, 0.5, 0, 2;
+    Eigen::MatrixXd res(x_ev.size(), 3);
+    fit.pdf_cdf(x_ev, res.col(0), res.col(1), res.col(2));
+    CHECK(res.col(0).isApprox(fit.pdf(x_ev), 1e-12));
+    CHECK(res.col(1).isApprox(fit.cdf(x_ev), 1e-12));
+    CHECK(res.col(2).array().exp().matrix().isApprox(res.col(0), 1e-12));
+
+    x_ev(0) = NAN;
+    fit.pdf_cdf(x_ev, res.col(0), res.col(1));
+    CHECK(std::isnan(res(0, 0)));
+    CHECK(std::isnan(res(0, 1)));
+    CHECK(res.col(1).tail(104).isApprox(fit.cdf(x_ev.tail(104)), 1e-12));
+  }
+
+  kde1d::Kde1d fit;
+  fit.fit(x_ub);
+  Eigen::VectorXd pdf(9), cdf(8);
+  CHECK_THROWS(fit.pdf_cdf(upoints, pdf, cdf));
+}
+
+TEST_CASE("sorted evaluation points", "[sorted]")
+{
+  kde1d::Kde1d fit(0, NAN);
+  fit.fit(x_lb);
+
+  // sorted (with ties, NaNs, and points outside the grid) and reversed
+  Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(1000, -1, 15);
+  x(10) = x(11);
+  x(500) = NAN;
+  Eigen::VectorXd x_rev = x.reverse();
+  Eigen::VectorXd pdf = fit.pdf(x), cdf = fit.cdf(x);
+  CHECK(std::isnan(pdf(500)));
+  CHECK(std::isnan(cdf(500)));
+  pdf(500) = cdf(500) = 0;
+  Eigen::VectorXd pdf_rev = fit.pdf(x_rev).reverse();
+  Eigen::VectorXd cdf_rev = fit.cdf(x_rev).reverse();
+  pdf_rev(500) = cdf_rev(500) = 0;
+  CHECK(pdf.isApprox(pdf_rev, 1e-14));
+  CHECK(cdf.isApprox(cdf_rev, 1e-14));
+}
+
+TEST_CASE("counter-based simulation", "[simulate]")
+{
+  using kde1d::stats::detail::philox4x32;
+
+  SECTION("philox matches the reference implementation")
+  {
+    std::array<uint32_t, 4> res = { 0x6627e8d5, 0xe169c58d, 0xbc57ac4c,
+                                    0x9b00dbd8 };
+    CHECK(philox4x32({ 0, 0, 0, 0 }, { 0, 0 }) == res);
+    res = { 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd };
+    CHECK(philox4x32({ 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff },
+                     { 0xffffffff, 0xffffffff }) == res);
+    res = { 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 };
+    CHECK(philox4x32({ 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 },
+                     { 0xa4093822, 0x299f31d0 }) == res);
+  }
+
+  SECTION("streams can be generated in chunks")
+  {
+    Eigen::VectorXd u(1001), u_chunk(1001);
+    kde1d::stats::simulate_uniform_philox(u, 5);
+    kde1d::stats::simulate_uniform_philox(u_chunk.head(333), 5);
+    kde1d::stats::simulate_uniform_philox(u_chunk.tail(668), 5, 333);
+    CHECK(u == u_chunk);
+    CHECK(u.minCoeff() > 0.0);
+    CHECK(u.maxCoeff() < 1.0);
+    CHECK(std::fabs(u.mean() - 0.5) < 0.05);
+    kde1d::stats::simulate_uniform_philox(u_chunk, 6);
+    CHECK(u != u_chunk);
+  }
+
+  SECTION("results don't depend on the number of threads")
+  {
+    for (std::string type : { "c", "d", "zi" }) {
+      kde1d::Kde1d fit(type == "c" ? NAN : 0.0, NAN, type);
+      fit.fit((type == "c") ? x_ub : x_lb.array().round().matrix());
+      Eigen::VectorXd x(10000), x_threads(10000);
+      fit.simulate_into(x, 1);
+      fit.simulate_into(x_threads, 1, 0, 3);
+      CHECK(x == x_threads);
+      fit.simulate_into(x_threads.tail(5000), 1, 5000, 2);
+      CHECK(x == x_threads);
+      if (type != "c")
+        CHECK(x.minCoeff() >= 0.0);
+    }
+    kde1d::Kde1d fit;
+    Eigen::VectorXd x(10);
+    CHECK_THROWS(fit.simulate_into(x, 1));
+    fit.fit(x_ub);
+    CHECK_THROWS(fit.simulate_into(x, 1, 0, 0));
+  }
+
+  SECTION("sobol sequences are stratified")
+  {
+    Eigen::VectorXd u(1024);
+    for (bool scramble : { false, true }) {
+      kde1d::stats::simulate_uniform_sobol(u, scramble, 3, 1024);
+      std::vector<int> counts(1024, 0);
+      for (Eigen::Index i = 0; i < u.size(); ++i)
+        counts[static_cast<size_t>(u(i) * 1024)]++;
+      CHECK(*std::min_element(counts.begin(), counts.end()) == 1);
+      CHECK(u.minCoeff() > 0.0);
+      CHECK(u.maxCoeff() < 1.0);
+    }
+    Eigen::VectorXd u2(1024);
+    kde1d::stats::simulate_uniform_sobol(u2, true, 4, 1024);
+    CHECK(u != u2);
+    CHECK_THROWS(kde1d::stats::simulate_uniform_sobol(u, true, 3, 1ull << 32));
+  }
+
+  SECTION("quasi-random simulation")
+  {
+    kde1d::Kde1d fit;
+    fit.fit(x_ub);
+    Eigen::VectorXd x(4096), x_threads(4096);
+    for (auto seq : { kde1d::SequenceType::sobol,
+                      kde1d::SequenceType::scrambled_sobol }) {
+      x = fit.simulate(4096, seq, 1);
+      fit.simulate_into(x_threads, seq, 1, 0, 3);
+      CHECK(x == x_threads);
+      // the simulated values are stratified on the probability scale
+      Eigen::VectorXd p = fit.cdf(x);
+      std::sort(p.data(), p.data() + p.size());
+      Eigen::VectorXd strata = Eigen::VectorXd::LinSpaced(4096, 0, 4095);
+      CHECK((p * 4096 - strata).cwiseAbs().maxCoeff() < 1.01);
+    }
+    fit.simulate_into(x, 1);
+    CHECK(x == fit.simulate(4096, kde1d::SequenceType::pseudo_random, 1));
+    CHECK_THROWS(fit.simulate_into(
+      x, kde1d::SequenceType::sobol, 1, (1ull << 32) - 10));
+  }
+}
+
+TEST_CASE("log-pdf evaluation", "[logpdf]")
+{
+  for (const auto& sample : samples) {
+    kde1d::Kde1d fit(sample.xmin, sample.xmax, sample.type);
+    fit.fit(sample.x);
+    Eigen::VectorXd x_ev(103);
+    x_ev << sample.x.tail(100), 0, 0.5, NAN;
+    Eigen::VectorXd pdf = fit.logpdf(x_ev).array().exp();
+    CHECK(pdf.head(102).isApprox(fit.pdf(x_ev.head(102)), 1e-12));
+    CHECK(std::isnan(pdf(102)));
+  }
+
+  // the Gaussian tails stay finite where the pdf underflows
+  kde1d::Kde1d fit(kde1d::interp::InterpolationGrid(
+    ugrid, Eigen::VectorXd::Ones(ugrid.size()), 3));
+  double width = ugrid(1) - ugrid(0);
+  Eigen::VectorXd x_ev(3);
+  x_ev << 0.99 + width, 0.99 + 100 * width, 0.99 + 1e4 * width;
+  Eigen::VectorXd logpdf = fit.logpdf(x_ev, false);
+  Eigen::VectorXd expected =
+    std::log(fit.get_values()(98)) -
+    0.5 * (x_ev.array() - ugrid(97)).square() / (width * width);
+  CHECK(fit.pdf(x_ev, false)(2) == 0);
+  CHECK(logpdf.isApprox(expected, 1e-12));
+  CHECK(std::exp(logpdf(0)) == Approx(fit.pdf(x_ev, false)(0)).epsilon(1e-12));
+
+  Eigen::MatrixXd res(3, 3);
+  fit.pdf_cdf(x_ev, res.col(0), res.col(1), res.col(2), false);
+  CHECK(res.col(2).isApprox(logpdf, 1e-12));
+
+  // fitted values may vanish on the outer grid points
+  Eigen::VectorXd x_tails(6);
+  x_tails << -1e3, -30, -10, 10, 30, 1e3;
+  for (size_t degree = 0; degree < 3; degree++) {
+    kde1d::Kde1d fit_ub(NAN, NAN, "c", 1, NAN, degree);
+    fit_ub.fit(x_ub);
+    Eigen::VectorXd log_tails = fit_ub.logpdf(x_tails);
+    CHECK(log_tails.allFinite());
+    CHECK(log_tails(0) < log_tails(1));
+    CHECK(log_tails(1) < log_tails(2));
+    CHECK(log_tails(3) > log_tails(4));
+    CHECK(log_tails(4) > log_tails(5));
+    CHECK(log_tails.maxCoeff() < std::log(fit_ub.pdf(x_ub).minCoeff()));
+
+    Eigen::MatrixXd res_ub(6, 3);
+    fit_ub.pdf_cdf(x_tails, res_ub.col(0), res_ub.col(1), res_ub.col(2));
+    CHECK(res_ub.col(2).isApprox(log_tails, 1e-12));
+  }
+}
+
+TEST_CASE("grid size and adaptive grids", "[grid]")
+{
+  for (const auto& sample : samples) {
+    if (sample.type != "c")
+      continue;
+    kde1d::Kde1d fit(sample.xmin, sample.xmax);
+    fit.set_grid_size(1001);
+    fit.fit(sample.x);
+    CHECK(fit.get_grid_points().size() == 1001);
+
+    kde1d::Kde1d fit_adaptive(sample.xmin, sample.xmax);
+    fit_adaptive.set_grid_size(1001);
+    fit_adaptive.set_adaptive_grid(1e-3);
+    fit_adaptive.fit(sample.x);
+    CHECK(fit_adaptive.get_grid_points().size() < 500);
+
+    Eigen::VectorXd x = fit.get_grid_points();
+    double err = (fit_adaptive.pdf(x) - fit.pdf(x)).cwiseAbs().maxCoeff();
+    CHECK(err <= 2e-3 * fit.pdf(x).maxCoeff());
+    CHECK(fit_adaptive.cdf(upoints).isApprox(fit.cdf(upoints), 1e-3));
+  }
+
+  kde1d::Kde1d fit;
+  CHECK_THROWS(fit.set_grid_size(4));
+  CHECK_THROWS(fit.set_adaptive_grid(NAN));
+}
+
+TEST_CASE("instrumentation", "[instrument]")
+{
+  kde1d::Kde1d fit(0, NAN);
+  fit.fit(x_lb);
+  fit.pdf(upoints);
+  auto profile = fit.get_profile();
+#ifdef KDE1D_INSTRUMENT
+  auto total = profile.get_stage("fit");
+  CHECK(total.calls == 1);
+  CHECK(profile.get_stage("pdf").calls == 1);
+  CHECK(profile.get_stage("boundary_transform").calls == 3);
+  CHECK(profile.get_stage("bandwidth").seconds <= total.seconds);
+  CHECK(profile.get_stage("jitter").calls == 0);
+  CHECK(instrument::get_global_profile().get_stage("fit").calls >= 1);
+#if defined(KDE1D_INSTRUMENT_MALLOC) && defined(__GLIBC__)
+  CHECK(total.allocations > 0);
+  CHECK(total.bytes > 0);
+#endif
+
+  fit.fit(x_lb);
+  CHECK(fit.get_profile().get_stage("pdf").calls == 0);
+#else
+  CHECK(profile.get_stages().empty());
+#endif
+}
+
+TEST_CASE("bandwidth selection methods", "[bandwidth]")
+{
+  auto points = stats::qnorm(upoints);
+  auto target = stats::dnorm(points);
+  std::vector<BandwidthMethod> methods = { BandwidthMethod::lscv,
+                                           BandwidthMethod::sj };
+
+  for (size_t degree = 0; degree < 3; degree++) {
+    kde1d::Kde1d fit0(NAN, NAN, VarType::continuous, 1, NAN, degree);
+    fit0.fit(x_ub);
+    for (auto method : methods) {
+      kde1d::Kde1d fit(NAN, NAN, VarType::continuous, 1, NAN, degree, method);
+      CHECK(fit.get_bandwidth_method() == method);
+      fit.fit(x_ub);
+      CHECK(fit.get_bandwidth() > 0.5 * fit0.get_bandwidth());
+      CHECK(fit.get_bandwidth() < 2.0 * fit0.get_bandwidth());
+      CHECK(fit.pdf(points).isApprox(target, pdf_tol));
+    }
+  }
+
+  SECTION("warm start")
+  {
+    Eigen::VectorXd x_new = x_ub;
+    x_new.head(100) *= 1.1;
+    for (auto method : { BandwidthMethod::plugin, BandwidthMethod::lscv }) {
+      kde1d::Kde1d fit0(NAN, NAN, VarType::continuous, 1, NAN, 2, method);
+      fit0.fit(x_ub);
+      kde1d::Kde1d fit1(NAN, NAN, VarType::continuous, 1, NAN, 2, method);
+      fit1.fit(x_new);
+
+      kde1d::Kde1d fit_warm(NAN, NAN, VarType::continuous, 1, NAN, 2, method);
+      fit_warm.set_warm_start(fit0);
+      fit_warm.fit(x_new);
+      CHECK(fit_warm.get_bandwidth() ==
+            Approx(fit1.get_bandwidth()).epsilon(0.1));
+
+      kde1d::Kde1d fit_skip(NAN, NAN, VarType::continuous, 1, NAN, 2, method);
+      fit_skip.set_warm_start(fit0, 0.1);
+      fit_skip.fit(x_new);
+      CHECK(fit_skip.get_bandwidth() == fit0.get_bandwidth());
+    }
+
+    kde1d::Kde1d fit_fixed(NAN, NAN, VarType::continuous, 1, 0.3, 2);
+    fit_fixed.fit(x_ub);
+    kde1d::Kde1d fit_lb(0, NAN, VarType::continuous);
+    fit_lb.fit(x_lb);
+    kde1d::Kde1d fit(NAN, NAN, VarType::continuous);
+    CHECK_THROWS(fit.set_warm_start(fit_fixed));
+    CHECK_THROWS(fit.set_warm_start(fit_lb));
+  }
+
+  SECTION("fixed bandwidth is not reselected")
+  {
+    kde1d::Kde1d fit(
+      NAN, NAN, VarType::continuous, 1, 0.3, 2, BandwidthMethod::lscv);
+    fit.fit(x_ub);
+    CHECK(fit.get_bandwidth() == 0.3);
+  }
+}
+
+TEST_CASE("log-likelihood and effective degrees of freedom", "[loglik][edf]")
+{
+  for (size_t degree = 0; degree < 3; degree++) {
+    kde1d::Kde1d fit(NAN, NAN, "continuous", 1, NAN, degree);
+    fit.fit(x_ub);
+    kde1d::Kde1d fit_copy = fit;
+
+    // computed on demand
+    CHECK(fit.get_edf() > 1.0);
+    CHECK(fit.get_loglik() == Approx(fit.pdf(x_ub).array().log().sum()));
+    CHECK(fit.get_loglik() == fit_copy.get_loglik());
+    CHECK(fit.get_edf() == fit_copy.get_edf());
+
+    // keeps values after refit of copy
+    fit_copy.fit(x_ub.head(n_sample / 2));
+    CHECK(fit.get_loglik() != fit_copy.get_loglik());
+  }
+
+  // the first access from concurrent threads computes the values once
+  kde1d::Kde1d fit_shared;
+  fit_shared.fit(x_ub);
+  std::vector<double> logliks(4);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < logliks.size(); ++t)
+    threads.emplace_back([&, t] { logliks[t] = fit_shared.get_loglik(); });
+  for (auto& thread : threads)
+    thread.join();
+  for (double loglik : logliks)
+    CHECK(loglik == fit_shared.get_loglik());
+  CHECK(fit_shared.get_edf() > 1.0);
+
+  kde1d::Kde1d fit_discrete(0, NAN, "discrete");
+  fit_discrete.fit(x_d);
+  CHECK(fit_discrete.get_loglik() ==
+        Approx(fit_discrete.pdf(x_d).array().log().sum()));
+
+  SECTION("binned approximation is close to exact values")
+  {
+    for (const auto& sample : samples) {
+      // discrete fits always compute the statistics from the observations
+      if (sample.type == "d")
+        continue;
+      for (size_t degree = 0; degree < 3; degree++) {
+        kde1d::Kde1d fit(sample.xmin, sample.xmax, sample.type, 1, NAN, degree);
+        fit.fit(sample.x);
+        kde1d::Kde1d fit_binned(
+          sample.xmin, sample.xmax, sample.type, 1, NAN, degree);
+        fit_binned.set_binned_stats(true);
+        fit_binned.fit(sample.x);
+
+        double n = static_cast<double>(n_sample);
+        CHECK(std::fabs(fit.get_loglik() - fit_binned.get_loglik()) < 2e-3 * n);
+        CHECK(fit_binned.get_edf() == Approx(fit.get_edf()).epsilon(0.05));
+      }
+    }
+  }
+
+  SECTION("mirrored data have the same edf")
+  {
+    kde1d::Kde1d fit_left(0, NAN, "c");
+    fit_left.fit(x_lb);
+    kde1d::Kde1d fit_right(NAN, 0, "c");
+    fit_right.fit(x_rb);
+    CHECK(fit_left.get_edf() == Approx(fit_right.get_edf()).epsilon(0.05));
+  }
+}
+
 TEST_CASE("continuous data, unbounded", "[continuous][unbounded]")
 {
 
@@ -112,6 +877,23 @@ TEST_CASE("continuous data, unbounded", "[continuous][unbounded]")
     }
   }
 
+  SECTION("local log-linear fit matches its closed form")
+  {
+    // for N(0, 1) data and bandwidth h, the kernel density estimate tends to
+    // the N(0, s^2) density with s^2 = 1 + h^2, and f1 / f0 to -x / s^2; the
+    // local log-linear estimate is f0 * exp(-h^2 (f1 / f0)^2 / 2)
+    double h = 0.5, s2 = 1 + h * h;
+    Eigen::VectorXd u = Eigen::VectorXd::LinSpaced(20000, 0.00005, 0.99995);
+    kde1d::Kde1d fit(NAN, NAN, "continuous", 1, h, 1);
+    fit.fit(stats::qnorm(u));
+    Eigen::VectorXd x(4);
+    x << -2, -1, 1, 2;
+    Eigen::VectorXd target =
+      (-x.array().square() * (0.5 / s2 + 0.5 * h * h / (s2 * s2))).exp();
+    Eigen::VectorXd ratio = fit.pdf(x) / fit.pdf(Eigen::VectorXd::Zero(1))(0);
+    CHECK(ratio.isApprox(target, 0.01));
+  }
+
   SECTION("works with weights")
   {
     kde1d::Kde1d fit;
@@ -193,6 +975,13 @@ TEST_CASE("continuous data, left boundary", "[continuous][left-boundary]")
       CHECK(fit.quantile(ugrid).maxCoeff() <= 10.0);
       CHECK(fit.simulate(10, { 1 }).maxCoeff() >= 0.0);
     }
+
+    // the smallest observation is isolated in the log domain, where the
+    // local quadratic fit degenerates
+    Eigen::VectorXd u = stats::simulate_uniform(100000, { 1 });
+    kde1d::Kde1d fit(0, NAN, "continuous", 1, 0.1, 2);
+    fit.fit(-(1 - u.array()).log());
+    CHECK(fit.pdf(points).isApprox(target, pdf_tol));
   }
 
   SECTION("works with weights")
@@ -431,6 +1220,17 @@ TEST_CASE("discrete data", "[discrete]")
     }
   }
 
+  SECTION("works with a right boundary only")
+  {
+    auto points =
+      Eigen::VectorXd::LinSpaced(nlevels, 0, static_cast<double>(nlevels) - 1);
+    kde1d::Kde1d fit(NAN, static_cast<double>(nlevels - 1), "discrete");
+    fit.fit(x_d);
+    kde1d::Kde1d fit0(NAN, NAN, "discrete");
+    fit0.fit(x_d);
+    CHECK(fit.pdf(points).isApprox(fit0.pdf(points), pdf_tol));
+  }
+
   SECTION("works with weights")
   {
     kde1d::Kde1d fit(NAN, NAN, "discrete");
@@ -440,6 +1240,9 @@ TEST_CASE("discrete data", "[discrete]")
     kde1d::Kde1d fit0(NAN, NAN, "discrete");
     fit0.fit(x_d);
 
+    // unweighted data is jittered implicitly, weighted data explicitly
+    CHECK(fit.get_bandwidth() == Approx(fit0.get_bandwidth()).epsilon(1e-12));
+    CHECK(fit.get_loglik() == Approx(fit0.get_loglik()).epsilon(1e-12));
     CHECK(fit.pdf(x_d).isApprox(fit0.pdf(x_d)));
 
     Eigen::VectorXd w1 = Eigen::VectorXd::Constant(n_sample, 1.0);
@@ -467,9 +1270,6 @@ TEST_CASE("discrete data", "[discrete]")
 
 TEST_CASE("zero-inflated data", "[zero-inflated]")
 {
-  Eigen::VectorXd x_zi = x_lb;
-  x_zi.head(n_sample / 4).setZero();
-
   SECTION("fit local constant, linear, quadratic")
   {
     for (size_t degree = 0; degree < 3; degree++) {
@@ -535,8 +1335,9 @@ TEST_CASE("zero-inflated data", "[zero-inflated]")
   {
     kde1d::Kde1d fit(NAN, NAN, "zero-inflated");
     auto w = Eigen::VectorXd::Constant(n_sample, 1);
-    x_zi(0) = NAN;
-    fit.fit(x_zi, w);
+    Eigen::VectorXd x = x_zi;
+    x(0) = NAN;
+    fit.fit(x, w);
 
     CHECK(fit.pdf(Eigen::VectorXd::Constant(2, NAN)).array().isNaN().all());
     CHECK(fit.cdf(Eigen::VectorXd::Constant(2, NAN)).array().isNaN().all());
@@ -548,8 +1349,7 @@ TEST_CASE("zero-inflated data", "[zero-inflated]")
   {
     kde1d::Kde1d fit(NAN, NAN, "zero-inflated");
     auto w = Eigen::VectorXd::Constant(n_sample, 1);
-    x_zi = Eigen::VectorXd::Zero(n_sample);
-    fit.fit(x_zi, w);
+    fit.fit(Eigen::VectorXd::Zero(n_sample), w);
 
     CHECK(fit.pdf(Eigen::VectorXd::Constant(2, 1)).cwiseEqual(0).all());
     CHECK(fit.cdf(Eigen::VectorXd::Constant(2, -0.1)).cwiseEqual(0).all());